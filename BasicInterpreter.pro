@@ -1,38 +1,18 @@
-QT       += core gui
+# core: the interpreter as a static library without Qt widgets
+# gui:  the BasicInterpreter IDE
+# cli:  basic-cli, a headless runner
+# enginetest: runs programs on every Run engine, `make check` runs it
+TEMPLATE = subdirs
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+SUBDIRS = core gui cli enginetest
 
-CONFIG += c++17
+core.file = core.pro
 
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+gui.file = gui.pro
+gui.depends = core
 
-SOURCES += \
-    basicinterpreter.cpp \
-    environment.cpp \
-    expression.cpp \
-    main.cpp \
-    mainwindow.cpp \
-    qstringexception.cpp \
-    statement.cpp
+cli.file = cli.pro
+cli.depends = core
 
-HEADERS += \
-    basicinterpreter.h \
-    declarations.h \
-    environment.h \
-    expression.h \
-    mainwindow.h \
-    qstringexception.h \
-    statement.h
-
-FORMS += \
-    mainwindow.ui
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
-
-DISTFILES += \
-    basic0
+enginetest.file = enginetest.pro
+enginetest.depends = core
@@ -0,0 +1,56 @@
+#include "arena.h"
+
+#include <algorithm>
+
+// blocks stop doubling at this size
+static const size_t MAX_BLOCK = 1 << 16;
+
+Arena::Arena(size_t firstBlock)
+    : firstBlock(firstBlock), nextBlock(firstBlock) {}
+
+Arena::~Arena() { clear(); }
+
+void Arena::destroyAt(void *address) {
+  auto *header = static_cast<Header *>(address) - 1;
+  if (!header->destroy) return;
+  header->destroy(address);
+  header->destroy = nullptr;
+  header->nextFree = freeLists.value(header->size);
+  freeLists[header->size] = header;
+}
+
+Arena::Header *Arena::takeFree(size_t size) {
+  auto i = freeLists.find(size);
+  if (i == freeLists.end() || !i.value()) return nullptr;
+  Header *header = i.value();
+  i.value() = header->nextFree;
+  return header;
+}
+
+void Arena::clear() {
+  for (Header *header = headers; header; header = header->next)
+    if (header->destroy) header->destroy(header + 1);
+  headers = nullptr;
+  freeLists.clear();
+
+  while (blocks) {
+    Block *next = blocks->next;
+    ::operator delete(blocks);
+    blocks = next;
+  }
+  cursor = limit = nullptr;
+  nextBlock = firstBlock;
+}
+
+void *Arena::grow(size_t size) {
+  size_t capacity = std::max(nextBlock, sizeof(Block) + size);
+  nextBlock = std::max(firstBlock, std::min(nextBlock * 2, MAX_BLOCK));
+
+  auto *block = static_cast<Block *>(::operator new(capacity));
+  block->next = blocks;
+  blocks = block;
+  // the data of a block starts aligned for any type
+  cursor = reinterpret_cast<char *>(block + 1) + size;
+  limit = reinterpret_cast<char *>(block) + capacity;
+  return block + 1;
+}
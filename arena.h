@@ -0,0 +1,119 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QHash>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Class: Arena
+ * ------------
+ * This class hands out memory by bumping a pointer through blocks that
+ * grow from firstBlock bytes, and frees everything at once in clear or
+ * the destructor.
+ * Objects with a destructor carry a small header so clear can run it,
+ * trivially destructible objects cost nothing but their size.
+ * The memory of a destroyed object is reused by the next object of the
+ * same size.
+ */
+class Arena {
+ public:
+  explicit Arena(size_t firstBlock = 256);
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  // construct a T in the arena
+  template <class T, class... Args>
+  T *make(Args &&...args);
+
+  // run the destructor of an object made by make before clear,
+  // its memory goes to the free list of its size; a polymorphic object
+  // may be passed by a pointer to its base
+  template <class T>
+  void destroy(T *object);
+
+  // destroy every object and free every block
+  void clear();
+
+ private:
+  struct alignas(std::max_align_t) Block {
+    Block *next;
+  };
+
+  struct alignas(std::max_align_t) Header {
+    Header *next;
+    // nullptr once the object is destroyed
+    void (*destroy)(void *object);
+    // bytes allocated for the header and the object
+    size_t size;
+    // next destroyed object of the same size
+    Header *nextFree;
+  };
+
+  Block *blocks = nullptr;
+  char *cursor = nullptr, *limit = nullptr;
+  size_t firstBlock, nextBlock;
+
+  // objects with a destructor, newest first, destroyed ones included
+  Header *headers = nullptr;
+
+  // destroyed objects by size, their memory can be reused by make
+  QHash<size_t, Header *> freeLists;
+
+  // destroy the object starting at address, which follows its header
+  void destroyAt(void *address);
+
+  // take a destroyed object of size bytes off its free list,
+  // return nullptr if there is none
+  Header *takeFree(size_t size);
+
+  void *allocate(size_t size, size_t align) {
+    auto p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(align - 1);
+    if (p + size > reinterpret_cast<uintptr_t>(limit)) return grow(size);
+    cursor = reinterpret_cast<char *>(p + size);
+    return reinterpret_cast<void *>(p);
+  }
+
+  // start a new block with room for size bytes
+  void *grow(size_t size);
+};
+
+template <class T, class... Args>
+T *Arena::make(Args &&...args) {
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "over-aligned types are not supported");
+  if constexpr (std::is_trivially_destructible<T>::value)
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+  const size_t size = sizeof(Header) + sizeof(T);
+  Header *header = takeFree(size);
+  if (!header) {
+    header = static_cast<Header *>(allocate(size, alignof(Header)));
+    header->size = size;
+    header->next = headers;
+    headers = header;
+  }
+  // a header stays in headers, so clear skips it until it is reused
+  header->destroy = nullptr;
+  T *object = new (header + 1) T(std::forward<Args>(args)...);
+  header->destroy = [](void *p) { static_cast<T *>(p)->~T(); };
+  return object;
+}
+
+template <class T>
+void Arena::destroy(T *object) {
+  // only objects with a destructor have a header in front of them
+  static_assert(!std::is_trivially_destructible<T>::value,
+                "trivially destructible objects are freed by clear only");
+  if constexpr (std::is_polymorphic<T>::value)
+    // the header is in front of the most derived object, not of a base
+    destroyAt(dynamic_cast<void *>(object));
+  else
+    destroyAt(object);
+}
+
+#endif  // ARENA_H
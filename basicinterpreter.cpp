@@ -1,56 +1,67 @@
 ﻿#include "basicinterpreter.h"
 
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSet>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <climits>
+#include <cstring>
+
+#include "bytecode.h"
+#include "controlflowgraph.h"
+#include "virtualmachine.h"
+
+// how a program ends after requestStop
+static const char *const STOPPED = "The program is stopped";
+
 void BasicInterpreter::parseCmd(QString cmd) {
-  if (cmd.isEmpty()) return;
+  if (cmd.trimmed().isEmpty()) return;
   auto parts = cmd.split(" ", Qt::SkipEmptyParts);
-  bool isLineNumber = false;
-  int index = parts[0].toInt(&isLineNumber);
   try {
     // part of the program
-    if (isLineNumber) {
-      if (parts.length() > 1)
-        insertLine(
-            index,
-            cmd.remove(cmd.indexOf(parts[0]), parts[0].length()).simplified());
-      else
-        removeLine(index);
-      emit sourceChanged();
-    }
+    if (editSource(cmd)) emit sourceChanged();
     // immediate statement
     else if (parts[0] == "PRINT") {
       setMode(Immediate);
-      immediateStatement = new PrintStatement(cmd);
-      immediateStatement->parse();
-      emit needOutput(
-          QString::number(immediateStatement->getFirstExp()->eval(*env)));
-      delete immediateStatement;
+      PrintStatement statement(cmd);
+      statement.parse(src.expressions());
+      statement.resolve(*env);
+      output->print(statement.getFirstExp()->eval(*env));
       setMode(Normal);
     } else if (parts[0] == "LET") {
       setMode(Immediate);
-      auto let = new LetStatement(cmd);
-      let->parse();
-      if (let->getType() == STR)
-        env->setValue(let->getVariable(), let->getVal());
+      LetStatement let(cmd);
+      let.parse(src.expressions());
+      let.resolve(*env);
+      if (let.getType() == STR)
+        env->setValue(let.getSlot(), let.getVal());
       else
-        env->setValue(let->getVariable(), let->getFirstExp()->eval(*env));
-      emit needPrintEnv(env->toString());
-      delete let;
+        env->setValue(let.getSlot(), let.getFirstExp()->eval(*env));
       setMode(Normal);
     } else if (parts[0] == "INPUT") {
       setMode(Immediate);
-      immediateStatement = new InputStatement(cmd);
-      immediateStatement->parse();
+      immediateLine = cmd;
+      delete immediateStatement;
+      immediateStatement = new InputStatement(immediateLine);
+      immediateStatement->parse(src.expressions());
+      immediateStatement->resolve(*env);
       emit needInput();
     } else if (parts[0] == "INPUTS") {
       setMode(Immediate);
-      immediateStatement = new InputsStatement(cmd);
-      immediateStatement->parse();
+      immediateLine = cmd;
+      delete immediateStatement;
+      immediateStatement = new InputsStatement(immediateLine);
+      immediateStatement->parse(src.expressions());
+      immediateStatement->resolve(*env);
       emit needInput();
     } else if (parts[0] == "PRINTF") {
       setMode(Immediate);
-      PrintfStatement *s = new PrintfStatement(cmd);
-      s->parse();
-      emit needOutput(s->compose(*env));
+      PrintfStatement statement(cmd);
+      statement.parse(src.expressions());
+      statement.resolve(*env);
+      output->print(statement.compose(*env));
       setMode(Normal);
     }
     // command
@@ -63,13 +74,19 @@ void BasicInterpreter::parseCmd(QString cmd) {
       // no need to implement
     } else if (parts[0] == "CLEAR") {
       src.clear();
+      compiled = false;
       env->clear();
       errLines.clear();
+      invalidLines.clear();
       emit needClearScreen();
     } else if (parts[0] == "QUIT") {
-      QApplication::quit();
+      // this may run on a worker thread, quit is only safe on the
+      // application's own thread
+      QMetaObject::invokeMethod(
+          QCoreApplication::instance(), []() { QCoreApplication::quit(); },
+          Qt::QueuedConnection);
     } else if (parts[0] == "HELP") {
-      emit needOutput(
+      output->print(
           "Basic Interpreter implemented by markcty. Please read Basic-doc "
           "before use");
     } else
@@ -78,185 +95,421 @@ void BasicInterpreter::parseCmd(QString cmd) {
     setMode(Normal);
     emit needPopUp(e.what());
   }
+  publish();
 }
 
-void BasicInterpreter::insertLine(int index, QString line) {
-  Statement *statement = nullptr;
-  auto parts = line.split(" ");
-  QString type = parts[0].simplified();
-  if (type == "REM")
-    statement = new RemStatement(line);
-  else if (type == "LET")
-    statement = new LetStatement(line);
-  else if (type == "PRINT")
-    statement = new PrintStatement(line);
-  else if (type == "INPUT")
-    statement = new InputStatement(line);
-  else if (type == "INPUTS")
-    statement = new InputsStatement(line);
-  else if (type == "GOTO")
-    statement = new GotoStatement(line);
-  else if (type == "IF")
-    statement = new IfStatement(line);
-  else if (type == "END")
-    statement = new EndStatement(line);
-  else if (type == "PRINTF")
-    statement = new PrintfStatement(line);
+bool BasicInterpreter::editSource(QString cmd) {
+  auto parts = cmd.split(" ", Qt::SkipEmptyParts);
+  if (parts.isEmpty()) return false;
+  bool isLineNumber = false;
+  int index = parts[0].toInt(&isLineNumber);
+  if (!isLineNumber) return false;
+  if (parts.length() > 1)
+    insertLine(
+        index,
+        cmd.remove(cmd.indexOf(parts[0]), parts[0].length()).simplified());
   else
-    statement = new InvalidStatement(line);
-  src[index] = statement;
+    removeLine(index);
+  return true;
+}
+
+void BasicInterpreter::load(QIODevice *device) {
+  QElapsedTimer timer;
+  timer.start();
+  int lines = 0;
+
+  // a regular file is read in place, without a copy of every line
+  auto *file = qobject_cast<QFile *>(device);
+  uchar *data = file && file->size() > 0 ? file->map(0, file->size()) : nullptr;
+  if (data) {
+    lines = loadMapped(reinterpret_cast<const char *>(data), file->size());
+    file->unmap(data);
+  } else {
+    QTextStream in(device);
+    QString line;
+    bool changed = false;
+    while (in.readLineInto(&line)) {
+      lines++;
+      if (editSource(line)) {
+        changed = true;
+        continue;
+      }
+      // a command sees the program loaded so far
+      if (changed) emit sourceChanged();
+      changed = false;
+      parseCmd(line);
+    }
+    if (changed) emit sourceChanged();
+  }
+
+  emit loaded(lines, timer.elapsed());
+}
+
+int BasicInterpreter::loadMapped(const char *data, qint64 size) {
+  const char *end = data + size;
+  const qint64 stride = size / 100 + 1;
+  qint64 nextProgress = stride;
+  int lines = 0;
+  bool changed = false;
+
+  // the text is UTF-8, a byte order mark is not part of the first line
+  const char *begin = data;
+  if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) begin += 3;
+
+  for (const char *p = begin; p < end;) {
+    auto *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (!eol) eol = end;
+    const char *last = eol;
+    if (last > p && last[-1] == '\r') last--;
+    lines++;
+
+    while (p < last && *p == ' ') p++;
+    int index;
+    const char *body;
+    if (p == last) {
+      // a blank line
+    } else if (parseLineNumber(p, last, index, body)) {
+      while (body < last && *body == ' ') body++;
+      if (body == last)
+        removeLine(index);
+      else
+        insertLine(index, QString::fromUtf8(body, last - body).simplified());
+      changed = true;
+    } else {
+      // a command sees the program loaded so far
+      if (changed) emit sourceChanged();
+      changed = false;
+      parseCmd(QString::fromUtf8(p, last - p));
+    }
+
+    p = eol + 1;
+    if (p - data >= nextProgress) {
+      emit loadProgress(qMin<qint64>(p - data, size), size);
+      nextProgress += stride;
+    }
+  }
+  if (changed) emit sourceChanged();
+  return lines;
+}
+
+bool BasicInterpreter::parseLineNumber(const char *begin, const char *end,
+                                       int &index, const char *&next) {
+  const char *p = begin;
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+  if (p == end || *p < '0' || *p > '9') return false;
+
+  qint64 value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    value = value * 10 + (*p - '0');
+    if (value > qint64(INT_MAX) + 1) return false;
+  }
+  if (negative) value = -value;
+  if (value > INT_MAX || (p < end && *p != ' ')) return false;
+
+  index = int(value);
+  next = p;
+  return true;
+}
+
+void BasicInterpreter::insertLine(int index, QString line) {
+  int current = pausedLine();
+  if (index == current) {
+    emit needPopUp("Line " + QString::number(index) +
+                   " can not be changed while the program is on it");
+    return;
+  }
+  src.insert(index, line);
+  compiled = false;
+  if (current == -1) return;
+
+  // the paused program may reach the new line before parseSrc runs again
+  Statement *statement = src.constFind(index).value();
+  statement->dirty = false;
+  try {
+    statement->parse(src.expressions());
+    statement->optimize();
+    statement->resolve(*env);
+  } catch (const QStringException &e) {
+    statement->statementType = ERR;
+  }
+  // lines after the new one moved
+  env->currentLine = src.constFind(current);
+}
+
+void BasicInterpreter::removeLine(int index) {
+  int current = pausedLine();
+  if (index == current) {
+    emit needPopUp("Line " + QString::number(index) +
+                   " can not be changed while the program is on it");
+    return;
+  }
+  if (!src.remove(index)) return;
+  compiled = false;
+  // lines after the removed one moved
+  if (current != -1) env->currentLine = src.constFind(current);
+}
+
+int BasicInterpreter::pausedLine() const {
+  if (m_mode != Run && m_mode != Debug) return -1;
+  return env->currentLine == src.constEnd() ? -1 : env->currentLine.key();
+}
+
+Program::const_iterator BasicInterpreter::jumpTarget(Statement *statement) {
+  if (compiled) return statement->getTarget();
+  // lines changed since the jumps were linked, their iterators may have
+  // moved to other lines
+  int line = statement->getLineNumber();
+  auto target = src.constFind(line);
+  if (target == src.constEnd())
+    throw QStringException("Line " + QString::number(line) +
+                           " does not exist");
+  return target;
 }
 
-void BasicInterpreter::removeLine(int index) { src.remove(index); }
+QString BasicInterpreter::getControlFlow() {
+  parseSrc();
+  return cfg->toString();
+}
+
+bool BasicInterpreter::hasEndedNormally() const { return endedNormally; }
+
+QList<int> BasicInterpreter::getInvalidLines() const { return invalidLines; }
+
+QString BasicInterpreter::getExpTree() {
+  parseSrc();
+  return expTree();
+}
+
+QString BasicInterpreter::expTree() const {
+  QString tree;
+  for (auto i = src.constBegin(); i != src.constEnd(); i++)
+    tree.push_back(QString::number(i.key()) + " " +
+                   i.value()->toTree(m_optimizedTree));
+  return tree;
+}
 
 QString BasicInterpreter::getSource() const {
   QStringList lines;
-  QMapIterator<int, Statement *> i(src);
-  while (i.hasNext()) {
-    i.next();
+  for (auto i = src.constBegin(); i != src.constEnd(); i++)
     lines.append(QString::number(i.key()) + " " + i.value()->toString());
-  }
   return lines.join("\n");
 }
 
 BasicInterpreter::BasicInterpreter(QObject *parent)
-    : QObject(parent), env(new Environment) {
+    : QObject(parent),
+      env(new Environment),
+      vm(new VirtualMachine(stopRequested, this)) {
   connect(this, &BasicInterpreter::nextStep, this, &BasicInterpreter::step);
+  signalOutput = new SignalOutputSink(this);
+  output = signalOutput;
+  connect(signalOutput, &SignalOutputSink::needOutput, this,
+          &BasicInterpreter::needOutput);
   setMode(Normal);
 }
 
+BasicInterpreter::~BasicInterpreter() {
+  delete immediateStatement;
+  delete bytecode;
+  delete cfg;
+  delete env;
+}
+
 void BasicInterpreter::step() {
+  if (!execute()) return;
+
+  QList<QPair<int, QColor>> lines;
+  if (env->currentLine != src.constEnd()) {
+    int offset = getLineOffset(env->currentLine.key());
+    lines.append(QPair<int, QColor>{offset, QColor(124, 252, 0)});
+    emit needPrintExpTree(env->currentLine.value()->toTree(m_optimizedTree));
+  }
+  lines.append(errLines);
+  emit needHighlight(lines);
+  publish();
+}
+
+void BasicInterpreter::runLoop() {
+  if (!compiled)
+    // lines changed while the program was paused, the bytecode and the
+    // blocks no longer match them
+    while (getMode() == Run && execute())
+      ;
+  else if (getEngine() == BytecodeEngine)
+    runBytecode();
+  else
+    runBlocks();
+}
+
+void BasicInterpreter::runBlocks() {
+  while (getMode() == Run) {
+    if (env->currentLine != src.constEnd()) {
+      // a run may start in the middle of a block after debugging
+      const ControlFlowGraph::Block &block = cfg->blockAt(env->currentLine);
+      for (auto i = env->currentLine; i != block.last; i++)
+        executeSimple(i.value());
+      env->currentLine = block.last;
+    }
+    if (!execute()) return;
+  }
+}
+
+void BasicInterpreter::runBytecode() {
+  int line = env->currentLine == src.constEnd() ? -1 : env->currentLine.key();
+  try {
+    line = vm->run(*bytecode, *env, *output, line);
+  } catch (const QStringException &) {
+    // publish the final values before the environment is reset, like execute
+    if (vm->endsProgram()) {
+      setMode(Normal);
+      env->clear(false);
+    }
+    throw;
+  }
+  if (line == -2)
+    throw QStringException(STOPPED);
+  else if (line == -1)
+    finish();
+  else {
+    env->currentLine = src.constFind(line);
+    publish();
+    emit needInput();
+  }
+}
+
+void BasicInterpreter::finish() {
+  endedNormally = true;
+  env->currentLine = src.constEnd();
+  setMode(Normal);
+  QList<QPair<int, QColor>> lines;
+  lines.append(errLines);
+  emit needHighlight(lines);
+  emit needPopUp("The program ends normally");
+  // the final values stay on show until the next run
+  env->clear(false);
+}
+
+void BasicInterpreter::publish() {
+  output->flush();
+  QVector<VariableState> changes = env->takeChanges();
+  if (!changes.isEmpty()) emit needUpdateEnv(changes);
+}
+
+int BasicInterpreter::evaluate(const Expression *exp) const {
+  if (m_engine == PostfixEngine && m_mode == Run) return exp->evalPostfix(*env);
+  return exp->eval(*env);
+}
+
+bool BasicInterpreter::execute() {
   if (env->currentLine == src.constEnd()) {
     setMode(Normal);
-    env->clear();
+    env->clear(false);
     throw QStringException("The program ends without an END statement");
   }
 
   if (env->currentLine.value()->statementType == ERR) {
     setMode(Normal);
-    env->clear();
+    env->clear(false);
     throw QStringException("The program ends because of a corrupted statement");
   }
 
-  auto shouldStep = [&]() {
-    if (getMode() == Run)
-      emit nextStep();
-    else {
-      QList<QPair<int, QColor>> lines;
-      if (env->currentLine != src.constEnd()) {
-        int offset = getLineOffset(env->currentLine.key());
-        lines.append(QPair<int, QColor>{offset, QColor(124, 252, 0)});
-        emit needPrintExpTree(env->currentLine.value()->toTree());
-      }
-      lines.append(errLines);
-      emit needHighlight(lines);
-    }
-  };
-
   Statement *statement = env->currentLine.value();
   switch (statement->statementType) {
-    case LET: {
-      auto *let = dynamic_cast<LetStatement *>(statement);
-      if (let->getType() == STR)
-        env->setValue(let->getVariable(), let->getVal());
-      else
-        env->setValue(statement->getVariable(),
-                      statement->getFirstExp()->eval(*env));
-      env->currentLine++;
-      emit needPrintEnv(env->toString());
-      shouldStep();
-      break;
-    }
     case GOTO: {
-      env->currentLine = src.constFind(statement->getLineNumber());
-      if (env->currentLine == src.constEnd())
-        throw QStringException("Line " +
-                               QString::number(statement->getLineNumber()) +
-                               " does not exist");
-      shouldStep();
-      break;
+      int from = env->currentLine.key();
+      env->currentLine = jumpTarget(statement);
+      checkStop(from);
+      return true;
     }
     case IF: {
-      QString op = statement->getOperator();
-      int lv = statement->getFirstExp()->eval(*env),
-          rv = statement->getSecondExp()->eval(*env);
-      if ((op == ">" && lv > rv) || (op == "=" && lv == rv) ||
-          (op == "<" && lv < rv)) {
-        env->currentLine = src.constFind(statement->getLineNumber());
-        if (env->currentLine == src.constEnd())
-          throw QStringException("Line " +
-                                 QString::number(statement->getLineNumber()) +
-                                 " does not exist");
-      } else
+      int lv = evaluate(statement->getFirstExp()),
+          rv = evaluate(statement->getSecondExp());
+      bool jump = false;
+      switch (statement->getComparison()) {
+        case GREATER:
+          jump = lv > rv;
+          break;
+        case EQUAL:
+          jump = lv == rv;
+          break;
+        case LESS:
+          jump = lv < rv;
+          break;
+      }
+      if (jump) {
+        int from = env->currentLine.key();
+        env->currentLine = jumpTarget(statement);
+        checkStop(from);
+      }
+      else
         env->currentLine++;
-      shouldStep();
-      break;
+      return true;
     }
     // the input statement is a special case because it requires
     // asynchronous treatment
-    case INPUT: {
-      emit needInput();
-      break;
-    }
+    case INPUT:
     case INPUTS: {
+      publish();
       emit needInput();
-      break;
+      return false;
     }
-    case PRINT: {
-      emit needOutput(QString::number(statement->getFirstExp()->eval(*env)));
-      env->currentLine++;
-      shouldStep();
-      break;
+    case END: {
+      finish();
+      return false;
     }
-    case PRINTF: {
-      auto st = dynamic_cast<PrintfStatement *>(statement);
-      emit needOutput(st->compose(*env));
+    default:
+      executeSimple(statement);
       env->currentLine++;
-      shouldStep();
+      return true;
+  }
+}
+
+void BasicInterpreter::executeSimple(Statement *statement) {
+  switch (statement->statementType) {
+    case LET: {
+      auto *let = static_cast<LetStatement *>(statement);
+      if (let->getType() == STR)
+        env->setValue(let->getSlot(), let->getVal());
+      else
+        env->setValue(let->getSlot(), evaluate(statement->getFirstExp()));
       break;
     }
-    case END: {
-      env->currentLine = src.constEnd();
-      setMode(Normal);
-      QList<QPair<int, QColor>> lines;
-      lines.append(errLines);
-      emit needHighlight(lines);
-      emit needPrintEnv(env->toString());
-      emit needPopUp("The program ends normally");
-      env->clear();
+    case PRINT:
+      output->print(evaluate(statement->getFirstExp()));
+      break;
+    case PRINTF:
+      output->print(static_cast<PrintfStatement *>(statement)->compose(*env));
       break;
-    }
     default:
-      env->currentLine++;
-      shouldStep();
       break;
   }
 }
 
 void BasicInterpreter::setInput(QString input) {
+  // the program may have been stopped while the input was typed
+  if (getMode() == Normal) return;
   auto currentStatement =
       getMode() == Immediate ? immediateStatement : env->currentLine.value();
 
   if (currentStatement->statementType == INPUT) {
     bool ok;
-    env->setValue(currentStatement->getVariable(), input.toInt(&ok));
+    env->setValue(currentStatement->getSlot(), input.toInt(&ok));
     if (!ok) {
       emit needPopUp("Input invalid");
       emit needInput();
       return;
     }
   } else
-    env->setValue(currentStatement->getVariable(), input);
-
-  emit needPrintEnv(env->toString());
+    env->setValue(currentStatement->getSlot(), input);
 
   if (getMode() == Immediate) {
     delete immediateStatement;
+    immediateStatement = nullptr;
     setMode(Normal);
   } else {
     env->currentLine++;
     if (getMode() == Run) try {
-        emit nextStep();
+        runLoop();
       } catch (QStringException &e) {
         setMode(Normal);
         emit needPopUp(e.what());
@@ -267,6 +520,7 @@ void BasicInterpreter::setInput(QString input) {
       lines.append(QPair<int, QColor>{offset, QColor(124, 252, 0)});
       lines.append(errLines);
       emit needHighlight(lines);
+      publish();
     }
   }
 }
@@ -274,6 +528,7 @@ void BasicInterpreter::setInput(QString input) {
 void BasicInterpreter::debug() {
   try {
     if (getMode() != Debug && !src.empty()) {
+      endedNormally = false;
       emit needClearScreen();
       parseSrc();
       setMode(Debug);
@@ -283,7 +538,10 @@ void BasicInterpreter::debug() {
       lines.append(QPair<int, QColor>{offset, QColor(124, 252, 0)});
       lines.append(errLines);
       emit needHighlight(lines);
-      emit needPrintExpTree(env->currentLine.value()->toTree());
+      // the basic blocks come first, later steps show only their line
+      emit needPrintExpTree(
+          cfg->toString() + "\n\n" +
+          env->currentLine.value()->toTree(m_optimizedTree));
     } else
       emit nextStep();
   } catch (const QStringException &err) {
@@ -295,49 +553,149 @@ void BasicInterpreter::debug() {
   }
 }
 
+void BasicInterpreter::requestStop() { stopRequested.storeRelaxed(1); }
+
+void BasicInterpreter::stop() {
+  stopRequested.storeRelaxed(0);
+  if (getMode() != Run && getMode() != Debug) return;
+  setMode(Normal);
+  emit needPopUp(STOPPED);
+}
+
+void BasicInterpreter::checkStop(int from) {
+  if (env->currentLine.key() <= from && stopRequested.loadRelaxed())
+    throw QStringException(STOPPED);
+}
+
 void BasicInterpreter::setMode(Mode m) {
+  // whatever was printed or assigned belongs to the previous mode
+  publish();
   m_mode = m;
   emit modeChanged(m_mode);
 }
 
 BasicInterpreter::Mode BasicInterpreter::getMode() { return m_mode; }
 
+void BasicInterpreter::setEngine(Engine e) { m_engine = e; }
+
+void BasicInterpreter::setOutputSink(OutputSink *sink) {
+  output->flush();
+  output = sink ? sink : signalOutput;
+}
+
+BasicInterpreter::Engine BasicInterpreter::getEngine() { return m_engine; }
+
+void BasicInterpreter::setOptimizedTree(bool optimized) {
+  m_optimizedTree = optimized;
+}
+
+bool BasicInterpreter::getOptimizedTree() { return m_optimizedTree; }
+
 void BasicInterpreter::run() {
   if (src.empty()) return;
 
   auto prev_mode = getMode();
   setMode(Run);
   if (prev_mode != Debug) {
+    endedNormally = false;
     env->currentLine = src.constBegin();
     parseSrc();
   }
 
-  QString tree;
-  for (auto i = src.constBegin(); i != src.constEnd(); i++)
-    tree.push_back(QString::number(i.key()) + " " + i.value()->toTree());
-  emit needPrintExpTree(tree);
-  emit nextStep();
+  emit needPrintExpTree(expTree());
+  runLoop();
 }
 
 int BasicInterpreter::getLineOffset(int key) const {
-  auto keys = src.keys();
-  return keys.indexOf(key);
+  return src.rank(key);
 }
 
 void BasicInterpreter::parseSrc() {
-  QMapIterator<int, Statement *> line(src);
-  int i = 0;
-  errLines.clear();
-  while (line.hasNext()) {
-    line.next();
+  QVector<Statement *> changed;
+  for (auto i = src.constBegin(); i != src.constEnd(); i++)
+    if (i.value()->dirty) changed.append(i.value());
+
+  // statements share nothing while parsing, so they are parsed in parallel
+  ExpressionPool &pool = src.expressions();
+  QtConcurrent::blockingMap(changed, [&pool](Statement *statement) {
+    statement->dirty = false;
+    try {
+      statement->parse(pool);
+      statement->optimize();
+    } catch (const QStringException &e) {
+      statement->statementType = ERR;
+    }
+  });
+
+  // slots are allocated in line order, and never move, so a statement
+  // parsed before is still resolved
+  for (Statement *statement : changed) {
+    if (statement->statementType == ERR) continue;
     try {
-      line.value()->parse();
+      statement->resolve(*env);
     } catch (const QStringException &e) {
-      line.value()->statementType = ERR;
+      statement->statementType = ERR;
+    }
+  }
+
+  int i = 0;
+  errLines.clear();
+  invalidLines.clear();
+  QStringList missingLines;
+  for (auto line = src.constBegin(); line != src.constEnd(); line++) {
+    Statement *statement = line.value();
+    if (statement->statementType == ERR) {
       QPair<int, QColor> pair{i, QColor(255, 0, 0)};
       errLines.append(pair);
+      invalidLines.append(line.key());
+    }
+    // a jump to a missing line is reported before the program starts
+    else if (!statement->link(src)) {
+      QPair<int, QColor> pair{i, QColor(255, 0, 0)};
+      errLines.append(pair);
+      invalidLines.append(line.key());
+      missingLines.append(
+          "Line " + QString::number(statement->getLineNumber()) +
+          " does not exist");
     }
     i++;
   }
   if (!errLines.empty()) emit needHighlight(errLines);
+  if (!missingLines.empty()) throw QStringException(missingLines.join("\n"));
+  if (!compiled) {
+    delete cfg;
+    cfg = new ControlFlowGraph(src);
+    // the bytecode reads the hoisted subexpressions too
+    hoistInvariants();
+    delete bytecode;
+    bytecode = new Bytecode(src);
+    compiled = true;
+  }
+}
+
+void BasicInterpreter::hoistInvariants() {
+  // slots written by each loop
+  QVector<QSet<int>> assigned(cfg->loops.size());
+  for (int loop = 0; loop < cfg->loops.size(); loop++) {
+    for (int b : cfg->loops[loop].blocks) {
+      const ControlFlowGraph::Block &block = cfg->blocks[b];
+      for (auto i = block.first;; i++) {
+        Statement *statement = i.value();
+        if (statement->statementType == LET ||
+            statement->statementType == INPUT ||
+            statement->statementType == INPUTS)
+          assigned[loop].insert(statement->getSlot());
+        if (i == block.last) break;
+      }
+    }
+  }
+
+  // the temporaries are allocated again, so every statement is visited,
+  // a statement that left its loop drops what it hoisted
+  env->clearTemporaries();
+  for (auto i = src.constBegin(); i != src.constEnd(); i++) {
+    if (i.value()->statementType == ERR) continue;
+    int loop = cfg->loopAt(i);
+    i.value()->hoistInvariants(loop == -1 ? nullptr : &assigned[loop], *env);
+  }
 }
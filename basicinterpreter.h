@@ -1,9 +1,10 @@
 #ifndef BASICINTERPRETER_H
 #define BASICINTERPRETER_H
 
-#include <QApplication>
+#include <QAtomicInt>
 #include <QColor>
 #include <QDebug>
+#include <QIODevice>
 #include <QMap>
 #include <QObject>
 #include <QString>
@@ -12,39 +13,86 @@
 #include "declarations.h"
 #include "environment.h"
 #include "expression.h"
+#include "outputsink.h"
+#include "program.h"
 #include "statement.h"
 
 /*
  * Class: BasicInterpreter
  * -----------------------
  * This class implements a Basic interpreter.
- * It stores the program in a QMap.
+ * It stores the program in a Program.
  * It interacts with the user interface(can be either GUI or cmd)
  * by sending signals(need...).
  */
 class BasicInterpreter : public QObject {
   Q_OBJECT
   Q_PROPERTY(Mode mode READ getMode WRITE setMode NOTIFY modeChanged)
+  Q_PROPERTY(Engine engine READ getEngine WRITE setEngine)
+  Q_PROPERTY(bool optimizedTree READ getOptimizedTree WRITE setOptimizedTree)
  public:
   enum Mode { Immediate, Run, Debug, Normal };
   Q_ENUM(Mode);
 
+  // how Run mode excutes the program, Debug mode always walks the tree
+  enum Engine { TreeEngine, PostfixEngine, BytecodeEngine };
+  Q_ENUM(Engine);
+
   BasicInterpreter(QObject *parent = nullptr);
+  ~BasicInterpreter();
 
   // The only interface: parse a command and call corresponding function
   void parseCmd(QString cmd);
 
+  // parse every line of device like parseCmd, but numbered lines only
+  // emit a single sourceChanged, emit loaded when done
+  // a file is memory mapped and reports its progress with loadProgress
+  void load(QIODevice *device);
+
   // return source
   QString getSource() const;
 
+  // parse the sources and return the dump of their basic blocks,
+  // throw like RUN if a jump target does not exist
+  QString getControlFlow();
+
+  // parse the sources and return the exp trees of every line, as printed
+  // by RUN, throw like getControlFlow
+  QString getExpTree();
+
+  // whether the last program run or debugged reached END
+  bool hasEndedNormally() const;
+
+  // the numbers of the lines that did not parse or jump to a missing
+  // line, when the sources were last parsed
+  QList<int> getInvalidLines() const;
+
   // setMode
   void setMode(Mode m);
 
   // getMode
   Mode getMode();
 
+  // setEngine
+  void setEngine(Engine e);
+
+  // getEngine
+  Engine getEngine();
+
+  // print PRINT and PRINTF lines to sink instead of needOutput,
+  // nullptr restores needOutput, the sink is not owned
+  void setOutputSink(OutputSink *sink);
+
+  // ask a running program to stop, safe to call from any thread,
+  // it ends with an error at its next backward jump
+  void requestStop();
+
+  // whether printed exp trees show the optimised expressions
+  void setOptimizedTree(bool optimized);
+  bool getOptimizedTree();
+
  signals:
-  // require a step
+  // require a step(Debug mode only, Run mode is driven by runLoop)
   void nextStep();
 
   // require a input(INPUT statement)
@@ -53,7 +101,7 @@ class BasicInterpreter : public QObject {
   // require a load from file
   void needLoad();
 
-  // require printing
+  // require printing, lines are separated by '\n'
   void needOutput(QString output);
 
   // require printing the exp tree
@@ -62,8 +110,8 @@ class BasicInterpreter : public QObject {
   // require a clear of the screen
   void needClearScreen();
 
-  // require printing environment
-  void needPrintEnv(QString output);
+  // require updating the environment view with the changed variables
+  void needUpdateEnv(QVector<VariableState> changes);
 
   // require pop up window
   void needPopUp(QString err);
@@ -77,6 +125,12 @@ class BasicInterpreter : public QObject {
   // source changed
   void sourceChanged();
 
+  // done bytes out of total have been loaded
+  void loadProgress(qint64 done, qint64 total);
+
+  // load finished, lines were read in elapsed milliseconds
+  void loaded(int lines, qint64 elapsed);
+
  public slots:
   // excute a statement
   void step();
@@ -87,36 +141,135 @@ class BasicInterpreter : public QObject {
   // start debug or step
   void debug();
 
+  // end the program after requestStop, even if it waits for INPUT or is
+  // being debugged, and let the next run start
+  void stop();
+
  private:
   // Mode
   Mode m_mode;
 
+  // Engine
+  Engine m_engine = TreeEngine;
+
+  // OptimizedTree
+  bool m_optimizedTree = false;
+
+  // set by requestStop, cleared by stop
+  QAtomicInt stopRequested = 0;
+
+  // called after a jump from line, throw if a stop was requested and the
+  // jump goes back, every loop goes through such a jump like in the
+  // bytecode
+  void checkStop(int from);
+
   // error lines that need to be highlighted
   QList<QPair<int, QColor>> errLines;
 
+  // the numbers of those lines
+  QList<int> invalidLines;
+
+  // set when a program reaches END, cleared when the next one starts
+  bool endedNormally = false;
+
   // sources
-  QMap<int, Statement *> src;
+  Program src;
 
   // runtime environment
   Environment *env;
 
-  // current immediate statement
-  Statement *immediateStatement;
+  // current immediate statement, owned until its input arrives
+  Statement *immediateStatement = nullptr;
+
+  // text of immediateStatement, kept until the input arrives
+  QString immediateLine;
 
-  // insert a line
+  // sources lowered by parseSrc
+  Bytecode *bytecode = nullptr;
+
+  // basic blocks and loops of the sources, built with bytecode
+  ControlFlowGraph *cfg = nullptr;
+
+  // whether bytecode and cfg match src, cleared whenever a line changes
+  bool compiled = false;
+
+  // where PRINT and PRINTF lines go, signalOutput emits needOutput
+  OutputSink *output;
+  SignalOutputSink *signalOutput;
+
+  // evaluate exp with the representation chosen by the engine
+  int evaluate(const Expression *exp) const;
+
+  // excutes bytecode in BytecodeEngine
+  VirtualMachine *vm;
+
+  // insert or remove a line if cmd starts with a line number,
+  // return false otherwise
+  bool editSource(QString cmd);
+
+  // load the size bytes of a mapped UTF-8 file, return the number of lines
+  int loadMapped(const char *data, qint64 size);
+
+  // read the line number token in [begin, end), set next to the end of it,
+  // return false if the line does not start with a line number
+  static bool parseLineNumber(const char *begin, const char *end, int &index,
+                              const char *&next);
+
+  // insert a line, a paused program goes on with the same line,
+  // which can not be changed
   void insertLine(int index, QString line);
 
-  // remove a line
+  // remove a line, like insertLine
   void removeLine(int index);
 
+  // the line number a paused program(Run or Debug mode) goes on with,
+  // -1 if no program is paused
+  int pausedLine() const;
+
+  // the exp trees of every line, the sources must be parsed
+  QString expTree() const;
+
+  // the line a GOTO or IF statement jumps to, looked up by its number
+  // if lines changed since parseSrc linked it, throw if it does not exist
+  Program::const_iterator jumpTarget(Statement *statement);
+
   // run the program
   void run();
 
+  // excute statements until END, INPUT or an error
+  void runLoop();
+
+  // excute the current statement and move to the next one,
+  // return false if the execution should pause(END or INPUT)
+  bool execute();
+
+  // excute a statement that always goes on with the next line
+  // (LET, PRINT, PRINTF or REM)
+  void executeSimple(Statement *statement);
+
+  // excute a block at a time until END, INPUT or an error, only the last
+  // statement of a block needs the checks of execute
+  void runBlocks();
+
+  // excute the bytecode until END, INPUT or an error
+  void runBytecode();
+
+  // the program reaches END
+  void finish();
+
+  // flush the output and report the changed variables,
+  // called whenever the execution pauses
+  void publish();
+
   // get the line offset of statement with key as its line number
   int getLineOffset(int key) const;
 
-  // parse sources, return true if no error, false otherwise
+  // parse sources and link jumps, throw if a jump target does not exist
   void parseSrc();
+
+  // hoist what each statement in a loop computes from variables the loop
+  // never assigns into hidden temporaries of env, after cfg is built
+  void hoistInvariants();
 };
 
 #endif  // BASICINTERPRETER_H
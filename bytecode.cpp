@@ -0,0 +1,146 @@
+#include "bytecode.h"
+
+Bytecode::Bytecode(const Program &src) {
+  // (pc of the jump, target line number), patched after all lines are known
+  QList<QPair<int, int>> jumps;
+  for (auto i = src.constBegin(); i != src.constEnd(); i++) {
+    entries[i.key()] = code.size();
+    compileStatement(i.key(), i.value(), jumps);
+  }
+  endEntry = append(
+      FAIL, addString("The program ends without an END statement"), 1);
+
+  // parseSrc has linked every jump, so all targets exist
+  for (const auto &jump : jumps) code[jump.first].a = entries[jump.second];
+}
+
+int Bytecode::entry(int line) const {
+  if (line == -1) return endEntry;
+  return entries.value(line, endEntry);
+}
+
+int Bytecode::append(OpCode op, int a, int b, int c) {
+  code.push_back(Instruction{op, a, b, c});
+  return code.size() - 1;
+}
+
+int Bytecode::addString(const QString &s) {
+  strings.push_back(s);
+  return strings.size() - 1;
+}
+
+void Bytecode::compileStatement(int line, Statement *statement,
+                                QList<QPair<int, int>> &jumps) {
+  temps.clear();
+  switch (statement->statementType) {
+    case LET: {
+      auto *let = dynamic_cast<LetStatement *>(statement);
+      if (let->getType() == STR)
+        append(STORE_STR, let->getSlot(), addString(let->getVal()));
+      else {
+        compileExpression(let->getFirstExp()->evaluated, 0);
+        append(STORE_INT, let->getSlot(), 0);
+      }
+      break;
+    }
+    case PRINT:
+      compileExpression(statement->getFirstExp()->evaluated, 0);
+      append(PRINT_INT, 0);
+      break;
+    case PRINTF:
+      formats.push_back(
+          compileFormat(dynamic_cast<PrintfStatement *>(statement)));
+      append(PRINT_FMT, formats.size() - 1);
+      break;
+    case INPUT:
+    case INPUTS:
+      append(WAIT_INPUT, line);
+      break;
+    case GOTO:
+      jumps.append({append(JUMP), statement->getTarget().key()});
+      break;
+    case IF: {
+      static const OpCode comparisons[] = {JUMP_GT, JUMP_EQ, JUMP_LT};
+      compileExpression(statement->getFirstExp()->evaluated, 0);
+      compileExpression(statement->getSecondExp()->evaluated, 1);
+      OpCode jump = comparisons[statement->getComparison()];
+      jumps.append({append(jump, 0, 0, 1), statement->getTarget().key()});
+      break;
+    }
+    case END:
+      append(HALT);
+      break;
+    case ERR:
+      append(FAIL,
+             addString("The program ends because of a corrupted statement"),
+             1);
+      break;
+    default:
+      break;
+  }
+}
+
+void Bytecode::compileExpression(Expression::Node *node, int dst) {
+  registerCount = qMax(registerCount, dst + 1);
+  switch (node->type) {
+    case Expression::CONSTANT:
+      append(LOAD_CONST, dst, node->getConstant());
+      break;
+    case Expression::IDENTIFIER:
+      append(LOAD_VAR, dst, node->getSlot());
+      break;
+    case Expression::COMPOUND: {
+      // the right operand goes to the next register so the left one survives
+      compileExpression(node->left, dst);
+      compileExpression(node->right, dst + 1);
+      static const OpCode operators[] = {ADD, SUB, MUL, DIV, POW};
+      auto *compound = static_cast<Expression::CompoundNode *>(node);
+      append(operators[compound->op], dst, dst, dst + 1);
+      break;
+    }
+    case Expression::COMMON: {
+      // statements are straight-line code, so the first occurrence of a
+      // common subexpression always runs before the others
+      compileExpression(node->left, dst);
+      int temp = temps.size();
+      temps.insert(node, temp);
+      tempCount = qMax(tempCount, temp + 1);
+      append(SAVE_TEMP, temp, dst);
+      break;
+    }
+    case Expression::REUSE:
+      append(LOAD_TEMP, dst, temps.value(node->left));
+      break;
+    case Expression::HOISTED: {
+      // the subexpression is only computed while its temporary is invalid
+      int temporary = static_cast<Expression::HoistedNode *>(node)->temporary;
+      int load = append(LOAD_HOISTED, dst, temporary);
+      compileExpression(node->left, dst);
+      append(SAVE_HOISTED, temporary, dst);
+      code[load].c = code.size();
+      break;
+    }
+  }
+}
+
+Bytecode::Format Bytecode::compileFormat(PrintfStatement *statement) {
+  Format format{statement->getFormat(), {}};
+  QStringList args = statement->getArgs();
+  QVector<int> argSlots = statement->getArgSlots();
+  for (int i = 0; i < args.size(); i++) {
+    const QString &arg = args[i];
+    // mirror PrintfStatement::compose, but resolve literals only once
+    if (arg.front() == '\'' || arg.front() == '"')
+      format.args.push_back({-1, Lexer::unquote(arg).toString()});
+    else if (arg.front().isDigit()) {
+      bool ok = true;
+      arg.toInt(&ok);
+      if (!ok)
+        format.args.push_back({-2, "compose error"});
+      else
+        format.args.push_back({-1, arg});
+    } else
+      format.args.push_back({argSlots[i], QString()});
+  }
+  return format;
+}
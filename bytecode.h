@@ -0,0 +1,104 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "declarations.h"
+#include "expression.h"
+#include "program.h"
+#include "statement.h"
+
+/*
+ * Class: Bytecode
+ * ---------------
+ * This class lowers a parsed program into a flat instruction stream
+ * which is executed by the VirtualMachine.
+ * Registers hold intermediate integers, variables are addressed by
+ * their Environment slot.
+ */
+class Bytecode {
+ public:
+  enum OpCode {
+    LOAD_CONST,    // r[a] = b
+    LOAD_VAR,      // r[a] = slot b
+    STORE_INT,     // slot a = r[b]
+    STORE_STR,     // slot a = strings[b]
+    ADD,           // r[a] = r[b] + r[c]
+    SUB,           // r[a] = r[b] - r[c]
+    MUL,           // r[a] = r[b] * r[c]
+    DIV,           // r[a] = r[b] / r[c]
+    POW,           // r[a] = r[b] ** r[c]
+    SAVE_TEMP,     // t[a] = r[b]
+    LOAD_TEMP,     // r[a] = t[b]
+    LOAD_HOISTED,  // if temporary b is valid r[a] = it, pc = c
+    SAVE_HOISTED,  // temporary a = r[b]
+    JUMP,          // pc = a
+    JUMP_GT,       // if r[b] > r[c] pc = a
+    JUMP_EQ,       // if r[b] = r[c] pc = a
+    JUMP_LT,       // if r[b] < r[c] pc = a
+    PRINT_INT,     // print r[a]
+    PRINT_FMT,     // print formats[a]
+    WAIT_INPUT,    // pause for the INPUT(S) statement at line a
+    HALT,          // END statement
+    FAIL           // throw strings[a], the program ends if b is set
+  };
+
+  struct Instruction {
+    OpCode op;
+    int a, b, c;
+  };
+
+  // an argument of PRINTF: a variable slot, a ready-made text(slot -1)
+  // or an error message(slot -2)
+  struct FormatArg {
+    int slot;
+    QString text;
+  };
+
+  struct Format {
+    QString format;
+    QVector<FormatArg> args;
+  };
+
+  explicit Bytecode(const Program &src);
+
+  QVector<Instruction> code;
+
+  // string literals and error messages
+  QStringList strings;
+
+  QVector<Format> formats;
+
+  // number of registers needed by the longest expression
+  int registerCount = 0;
+
+  // number of temporaries holding the common subexpressions of the
+  // statement that has the most, they only live during one statement
+  int tempCount = 0;
+
+  // return the pc where the statement at line starts,
+  // -1 means the end of the program
+  int entry(int line) const;
+
+ private:
+  // line number -> pc
+  QMap<int, int> entries;
+
+  int endEntry = 0;
+
+  int append(OpCode op, int a = 0, int b = 0, int c = 0);
+  int addString(const QString &s);
+  void compileStatement(int line, Statement *statement,
+                        QList<QPair<int, int>> &jumps);
+  void compileExpression(Expression::Node *node, int dst);
+
+  // temporary of each common subexpression of the current statement
+  QHash<const Expression::Node *, int> temps;
+  Format compileFormat(PrintfStatement *statement);
+};
+
+#endif  // BYTECODE_H
@@ -0,0 +1,107 @@
+#include <QCoreApplication>
+#include <QFile>
+#include <QMap>
+#include <QTextStream>
+
+#include "basicinterpreter.h"
+
+/*
+ * basic-cli: run a BASIC program without the GUI
+ * ----------------------------------------------
+ * usage: basic-cli [--cfg] [--tree] [--optimized-tree]
+ *                  [--engine=tree|postfix|bytecode] FILE
+ * The file is loaded as if it was typed line by line and then RUN.
+ * With --cfg the basic blocks of the program are printed instead, with
+ * --tree its exp trees, --optimized-tree shows them after simplification.
+ * --engine chooses how RUN executes the program, tree by default.
+ * INPUT and INPUTS read one line each from stdin, PRINT and PRINTF write
+ * to stdout, errors and prompts go to stderr.
+ * The exit status is 0 only if every line parses and the program reaches
+ * END, 1 otherwise, 2 for a bad command line.
+ */
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QTextStream in(stdin), out(stdout), err(stderr);
+
+  static const QMap<QString, BasicInterpreter::Engine> engines{
+      {"tree", BasicInterpreter::TreeEngine},
+      {"postfix", BasicInterpreter::PostfixEngine},
+      {"bytecode", BasicInterpreter::BytecodeEngine}};
+  QStringList args = a.arguments();
+  bool dumpControlFlow = false, dumpTree = false, optimizedTree = false;
+  bool valid = args.size() >= 2;
+  BasicInterpreter::Engine engine = BasicInterpreter::TreeEngine;
+  for (int i = 1; i < args.size() - 1; i++) {
+    if (args[i] == "--cfg")
+      dumpControlFlow = true;
+    else if (args[i] == "--tree")
+      dumpTree = true;
+    else if (args[i] == "--optimized-tree")
+      dumpTree = optimizedTree = true;
+    else if (args[i].startsWith("--engine=") &&
+             engines.contains(args[i].mid(9)))
+      engine = engines.value(args[i].mid(9));
+    else
+      valid = false;
+  }
+  if (!valid) {
+    err << "usage: basic-cli [--cfg] [--tree] [--optimized-tree] "
+           "[--engine=tree|postfix|bytecode] FILE\n";
+    return 2;
+  }
+  QFile file(args.last());
+  if (!file.open(QIODevice::ReadOnly | QFile::Text)) {
+    err << "Cannot open file: " << file.errorString() << "\n";
+    return 1;
+  }
+
+  BasicInterpreter interpreter;
+  interpreter.setEngine(engine);
+  interpreter.setOptimizedTree(optimizedTree);
+  StreamOutputSink output(out);
+  interpreter.setOutputSink(&output);
+  bool waiting = false;
+  QObject::connect(&interpreter, &BasicInterpreter::needPopUp,
+                   [&](QString message) { err << message << "\n"; });
+  // answering inside the signal would nest every INPUT in the previous one
+  QObject::connect(&interpreter, &BasicInterpreter::needInput,
+                   [&]() { waiting = true; });
+
+  interpreter.load(&file);
+  file.close();
+
+  if (dumpControlFlow) {
+    try {
+      out << interpreter.getControlFlow() << "\n";
+    } catch (const QStringException &e) {
+      err << e.what() << "\n";
+      return 1;
+    }
+    return interpreter.getInvalidLines().isEmpty() ? 0 : 1;
+  }
+  if (dumpTree) {
+    try {
+      QString tree = interpreter.getExpTree();
+      out << tree << (tree.endsWith('\n') ? "" : "\n");
+    } catch (const QStringException &e) {
+      err << e.what() << "\n";
+      return 1;
+    }
+    return interpreter.getInvalidLines().isEmpty() ? 0 : 1;
+  }
+
+  interpreter.parseCmd("RUN");
+  while (waiting) {
+    waiting = false;
+    err << " ? ";
+    err.flush();
+    if (in.atEnd()) {
+      err << "\nunexpected end of input\n";
+      return 1;
+    }
+    interpreter.setInput(in.readLine().simplified());
+  }
+  bool succeeded = interpreter.hasEndedNormally() &&
+                   interpreter.getInvalidLines().isEmpty();
+  return succeeded ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+TARGET = basic-cli
+
+QT = core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(core.pri)
+
+SOURCES += \
+    cli.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
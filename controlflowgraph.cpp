@@ -0,0 +1,175 @@
+#include "controlflowgraph.h"
+
+#include <algorithm>
+
+ControlFlowGraph::ControlFlowGraph(const Program &src) {
+  int size = src.size();
+  // mark the first line of every block, then number the blocks
+  blockOf.fill(0, size);
+  if (size) blockOf[0] = 1;
+  for (auto i = src.constBegin(); i != src.constEnd(); i++) {
+    Statement *statement = i.value();
+    if (statement->statementType == GOTO || statement->statementType == IF)
+      blockOf[statement->getTarget().position()] = 1;
+    if (endsBlock(statement) && i.position() + 1 < size)
+      blockOf[i.position() + 1] = 1;
+  }
+
+  for (auto i = src.constBegin(); i != src.constEnd(); i++) {
+    if (blockOf[i.position()]) blocks.append(Block{i, i, {}, {}});
+    blocks.last().last = i;
+    blockOf[i.position()] = blocks.size() - 1;
+  }
+
+  auto addEdge = [this](int from, int to) {
+    if (blocks[from].successors.contains(to)) return;
+    blocks[from].successors.append(to);
+    if (to != EXIT) blocks[to].predecessors.append(from);
+  };
+  for (int b = 0; b < blocks.size(); b++) {
+    Statement *last = blocks[b].last.value();
+    // the line after a block always starts the next one
+    int next = blocks[b].last.position() + 1 < size ? b + 1 : EXIT;
+    switch (last->statementType) {
+      case GOTO:
+        addEdge(b, blockOf[last->getTarget().position()]);
+        break;
+      case IF:
+        addEdge(b, next);
+        addEdge(b, blockOf[last->getTarget().position()]);
+        break;
+      case END:
+      case ERR:
+        break;
+      default:
+        addEdge(b, next);
+        break;
+    }
+  }
+  findLoops();
+}
+
+void ControlFlowGraph::findLoops() {
+  innermost.fill(-1, blocks.size());
+  if (blocks.isEmpty()) return;
+
+  // reverse postorder of the blocks reachable from the first one
+  QVector<int> order, rank(blocks.size(), -1);
+  QVector<QPair<int, int>> path{{0, 0}};
+  rank[0] = 0;
+  while (!path.isEmpty()) {
+    int b = path.last().first, &next = path.last().second;
+    if (next < blocks[b].successors.size()) {
+      int successor = blocks[b].successors[next++];
+      if (successor == EXIT || rank[successor] != -1) continue;
+      rank[successor] = 0;
+      path.append({successor, 0});
+    } else {
+      order.append(b);
+      path.removeLast();
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  for (int i = 0; i < order.size(); i++) rank[order[i]] = i;
+
+  // immediate dominators, by Cooper, Harvey and Kennedy's iteration
+  QVector<int> dominator(blocks.size(), -1);
+  dominator[0] = 0;
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (rank[a] > rank[b]) a = dominator[a];
+      while (rank[b] > rank[a]) b = dominator[b];
+    }
+    return a;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int b : order) {
+      if (b == 0) continue;
+      int dominance = -1;
+      for (int predecessor : blocks[b].predecessors)
+        if (dominator[predecessor] != -1)
+          dominance = dominance == -1 ? predecessor
+                                      : intersect(predecessor, dominance);
+      if (dominator[b] != dominance) {
+        dominator[b] = dominance;
+        changed = true;
+      }
+    }
+  }
+  auto dominates = [&](int a, int b) {
+    while (b != a && b != 0) b = dominator[b];
+    return b == a;
+  };
+
+  // a back edge jumps to a block dominating its source, the loop is what
+  // reaches one of the sources of its header without passing it
+  QVector<QVector<int>> latches(blocks.size());
+  for (int b : order)
+    for (int header : blocks[b].successors)
+      if (header != EXIT && dominates(header, b)) latches[header].append(b);
+
+  QVector<int> seen(blocks.size(), -1);
+  for (int header : order) {
+    if (latches[header].isEmpty()) continue;
+    Loop loop{header, {header}};
+    seen[header] = header;
+    QVector<int> pending = latches[header];
+    while (!pending.isEmpty()) {
+      int b = pending.takeLast();
+      if (seen[b] == header) continue;
+      seen[b] = header;
+      loop.blocks.append(b);
+      for (int predecessor : blocks[b].predecessors)
+        if (dominator[predecessor] != -1) pending.append(predecessor);
+    }
+    loops.append(loop);
+  }
+
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const Loop &a, const Loop &b) {
+                     return a.blocks.size() > b.blocks.size();
+                   });
+  for (int loop = 0; loop < loops.size(); loop++)
+    for (int b : loops[loop].blocks) innermost[b] = loop;
+}
+
+QString ControlFlowGraph::toString() const {
+  QStringList lines;
+  for (int b = 0; b < blocks.size(); b++) {
+    const Block &block = blocks[b];
+    QString line = "B" + QString::number(b) + " " +
+                   QString::number(block.first.key()) + ".." +
+                   QString::number(block.last.key());
+    if (!block.predecessors.isEmpty()) {
+      line.append(" <-");
+      for (int predecessor : block.predecessors)
+        line.append(" B" + QString::number(predecessor));
+    }
+    line.append(" ->");
+    for (int successor : block.successors)
+      line.append(successor == EXIT ? QString(" exit")
+                                    : " B" + QString::number(successor));
+    lines.append(line);
+  }
+  for (const Loop &loop : loops) {
+    QString line = "loop B" + QString::number(loop.header) + ":";
+    for (int b : loop.blocks) line.append(" B" + QString::number(b));
+    lines.append(line);
+  }
+  return lines.join("\n");
+}
+
+bool ControlFlowGraph::endsBlock(const Statement *statement) {
+  switch (statement->statementType) {
+    case GOTO:
+    case IF:
+    case INPUT:
+    case INPUTS:
+    case END:
+    case ERR:
+      return true;
+    default:
+      return false;
+  }
+}
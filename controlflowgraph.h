@@ -0,0 +1,90 @@
+#ifndef CONTROLFLOWGRAPH_H
+#define CONTROLFLOWGRAPH_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "declarations.h"
+#include "program.h"
+#include "statement.h"
+
+/*
+ * Class: ControlFlowGraph
+ * -----------------------
+ * This class splits a parsed program into basic blocks: runs of lines
+ * that are only entered at the first one and only jump, pause or stop at
+ * the last one. A block starts at the first line, at a jump target and
+ * after a GOTO, IF, INPUT, INPUTS, END or corrupted statement.
+ * Edges follow the linked GOTO and IF targets and the fall through to
+ * the next line.
+ * Loops are the natural loops of the back edges, the jumps to a block
+ * that every path from the first line passes before the jump.
+ */
+class ControlFlowGraph {
+ public:
+  // successor of a block falling through the last line of the program
+  static const int EXIT = -1;
+
+  struct Block {
+    // the first and the last line of the block
+    Program::const_iterator first, last;
+
+    // blocks that may run after this one, an IF falls through first
+    QVector<int> successors;
+
+    // blocks that may run right before this one
+    QVector<int> predecessors;
+  };
+
+  /*
+   * Struct: Loop
+   * ------------
+   * The header of a natural loop and every block that reaches one of its
+   * back edges without passing the header.
+   */
+  struct Loop {
+    int header;
+
+    // blocks of the loop, the header first
+    QVector<int> blocks;
+  };
+
+  // build the graph of src, whose jumps must be linked
+  explicit ControlFlowGraph(const Program &src);
+
+  QVector<Block> blocks;
+
+  // one loop per header, an outer loop comes before the loops it contains
+  QVector<Loop> loops;
+
+  // return the block containing line, which must not be the end
+  const Block &blockAt(Program::const_iterator line) const {
+    return blocks[blockOf[line.position()]];
+  }
+
+  // return the innermost loop containing line, -1 if there is none
+  int loopAt(Program::const_iterator line) const {
+    return innermost[blockOf[line.position()]];
+  }
+
+  // one block per line, e.g. "B1 20..40 <- B0 B1 -> B1 B2",
+  // a block falling off the end of the program goes to "exit",
+  // then one line per loop, e.g. "loop B1: B1 B2"
+  QString toString() const;
+
+ private:
+  // block of each line, by position
+  QVector<int> blockOf;
+
+  // innermost loop containing each block, -1 outside loops
+  QVector<int> innermost;
+
+  // find the natural loops once the edges are known
+  void findLoops();
+
+  // whether a block ends with statement
+  static bool endsBlock(const Statement *statement);
+};
+
+#endif  // CONTROLFLOWGRAPH_H
@@ -0,0 +1,17 @@
+# link against the core library built by core.pro
+QT += concurrent
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+win32:CONFIG(release, debug|release) {
+    LIBS += -L$$OUT_PWD/release -lbasiccore
+    win32-g++: PRE_TARGETDEPS += $$OUT_PWD/release/libbasiccore.a
+    else: PRE_TARGETDEPS += $$OUT_PWD/release/basiccore.lib
+} else:win32:CONFIG(debug, debug|release) {
+    LIBS += -L$$OUT_PWD/debug -lbasiccore
+    win32-g++: PRE_TARGETDEPS += $$OUT_PWD/debug/libbasiccore.a
+    else: PRE_TARGETDEPS += $$OUT_PWD/debug/basiccore.lib
+} else {
+    LIBS += -L$$OUT_PWD -lbasiccore
+    PRE_TARGETDEPS += $$OUT_PWD/libbasiccore.a
+}
@@ -0,0 +1,39 @@
+TEMPLATE = lib
+TARGET = basiccore
+
+QT = core gui concurrent
+
+CONFIG += c++17 staticlib
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+    arena.cpp \
+    basicinterpreter.cpp \
+    bytecode.cpp \
+    controlflowgraph.cpp \
+    environment.cpp \
+    expression.cpp \
+    lexer.cpp \
+    outputsink.cpp \
+    program.cpp \
+    qstringexception.cpp \
+    statement.cpp \
+    virtualmachine.cpp
+
+HEADERS += \
+    arena.h \
+    basicinterpreter.h \
+    bytecode.h \
+    controlflowgraph.h \
+    declarations.h \
+    environment.h \
+    expression.h \
+    lexer.h \
+    outputsink.h \
+    program.h \
+    qstringexception.h \
+    statement.h \
+    virtualmachine.h
@@ -1,8 +1,21 @@
 #ifndef DECLARATIONS_H
 #define DECLARATIONS_H
 
+#include <QString>
+
 enum VariableType { INT, STR };
 
+// a variable as shown to the user, value is already formatted,
+// defined is false once the variable has been cleared
+struct VariableState {
+  QString name;
+  VariableType type;
+  QString value;
+  bool defined;
+};
+
+enum Comparison { GREATER, EQUAL, LESS };
+
 enum StatementType {
   REM,
   LET,
@@ -26,4 +39,12 @@ class Environment;
 
 class Expression;
 
+class ExpressionPool;
+
+class Bytecode;
+
+class ControlFlowGraph;
+
+class VirtualMachine;
+
 #endif  // DECLARATIONS_H
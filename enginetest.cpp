@@ -0,0 +1,211 @@
+#include <QCoreApplication>
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+
+#include "basicinterpreter.h"
+
+/*
+ * enginetest: check that every Run engine agrees
+ * ----------------------------------------------
+ * Each program is run on the tree, postfix and bytecode engines, the
+ * printed lines, the messages and the final variables must be the same,
+ * and the tree engine must print the expected lines.
+ * INPUT and INPUTS are answered from a list, one value at a time.
+ * A stopped case asks for a stop before it runs, so it ends at the first
+ * backward jump.
+ * The basic blocks and loops some programs dump with --cfg are checked
+ * too.
+ */
+
+namespace {
+
+struct Case {
+  QString name;
+  QStringList lines;
+  QStringList inputs;
+  QString expected;
+  bool stopped = false;
+};
+
+/*
+ * Struct: Result
+ * --------------
+ * What a run leaves behind, variables are kept by name as shown by the
+ * environment view.
+ */
+struct Result {
+  QString output;
+  QStringList messages;
+  QMap<QString, QString> variables;
+
+  bool operator==(const Result &other) const {
+    return output == other.output && messages == other.messages &&
+           variables == other.variables;
+  }
+};
+
+Result run(const Case &test, BasicInterpreter::Engine engine) {
+  Result result;
+  BasicInterpreter interpreter;
+  interpreter.setEngine(engine);
+  bool waiting = false;
+  QObject::connect(&interpreter, &BasicInterpreter::needOutput,
+                   [&](QString output) { result.output += output + "\n"; });
+  QObject::connect(&interpreter, &BasicInterpreter::needPopUp,
+                   [&](QString message) { result.messages.append(message); });
+  QObject::connect(&interpreter, &BasicInterpreter::needUpdateEnv,
+                   [&](QVector<VariableState> changes) {
+                     for (const VariableState &change : changes)
+                       if (change.defined)
+                         result.variables[change.name] = change.value;
+                       else
+                         result.variables.remove(change.name);
+                   });
+  // answering inside the signal would nest every INPUT in the previous one
+  QObject::connect(&interpreter, &BasicInterpreter::needInput,
+                   [&]() { waiting = true; });
+
+  for (const QString &line : test.lines) interpreter.parseCmd(line);
+  if (test.stopped) interpreter.requestStop();
+  interpreter.parseCmd("RUN");
+  QStringList inputs = test.inputs;
+  while (waiting && !inputs.isEmpty()) {
+    waiting = false;
+    interpreter.setInput(inputs.takeFirst());
+  }
+  if (waiting) result.messages.append("unexpected end of input");
+  return result;
+}
+
+/*
+ * Struct: ControlFlowCase
+ * -----------------------
+ * A program and the dump getControlFlow must return for it.
+ */
+struct ControlFlowCase {
+  QString name;
+  QStringList lines;
+  QString expected;
+};
+
+QString controlFlow(const ControlFlowCase &test) {
+  BasicInterpreter interpreter;
+  for (const QString &line : test.lines) interpreter.parseCmd(line);
+  try {
+    return interpreter.getControlFlow();
+  } catch (const QStringException &e) {
+    return e.what();
+  }
+}
+
+QString describe(const Result &result) {
+  QStringList variables;
+  for (auto i = result.variables.constBegin(); i != result.variables.constEnd();
+       i++)
+    variables.append(i.key() + " = " + i.value());
+  return "output:\n" + result.output +
+         "messages: " + result.messages.join(" | ") +
+         "\nvariables: " + variables.join(", ") + "\n";
+}
+
+const QList<Case> cases{
+    {"goto and if",
+     {"10 LET i = 0", "20 LET s = 0", "30 LET s = s + i * i",
+      "40 LET i = i + 1", "50 IF i < 10 THEN 30", "60 GOTO 80",
+      "70 PRINT 999", "80 PRINT s", "90 IF s > 200 THEN 110",
+      "100 PRINT 0 - 1", "110 END"},
+     {},
+     "285\n"},
+    {"input resumes the run",
+     {"10 INPUT n", "20 LET t = 0", "30 INPUT x", "40 LET t = t + x",
+      "50 LET n = n - 1", "60 IF n > 0 THEN 30", "70 INPUTS name",
+      "80 PRINTF \"{} got {}\", name, t", "90 END"},
+     {"3", "4", "5", "6", "bob"},
+     "bob got 15\n"},
+    {"hoisted temporaries",
+     {"10 LET a = 3", "20 LET b = 4", "30 LET r = 0", "40 LET i = 0",
+      "50 PRINT (a + b) * (a - b) + i", "60 LET i = i + 1",
+      "70 IF i < 2 THEN 50", "80 LET r = r + 1", "90 LET a = a + r * 10",
+      "100 INPUT b", "110 IF r < 3 THEN 40", "120 PRINT (a + b) * (a - b)",
+      "130 END"},
+     {"1", "2", "5"},
+     "-7\n-6\n168\n169\n1085\n1086\n3944\n"},
+    {"runtime error keeps the variables",
+     {"10 LET a = 7", "20 LET b = a - 7", "30 PRINT a * 2", "40 PRINT a / b",
+      "50 END"},
+     {},
+     "14\n"},
+    {"missing end",
+     {"10 LET a = 2", "20 PRINT a ** 10"},
+     {},
+     "1024\n"},
+    {"stop ends an endless loop",
+     {"10 LET a = 1", "20 PRINT a", "30 IF a > 0 THEN 50", "40 PRINT 0",
+      "50 LET a = a + 1", "60 GOTO 20"},
+     {},
+     "1\n",
+     true},
+};
+
+const QList<ControlFlowCase> controlFlowCases{
+    {"nested loops",
+     {"10 LET i = 0", "20 LET j = 0", "30 LET j = j + 1",
+      "40 IF j < 3 THEN 30", "50 LET i = i + 1", "60 IF i < 2 THEN 20",
+      "70 END"},
+     "B0 10..10 -> B1\n"
+     "B1 20..20 <- B0 B3 -> B2\n"
+     "B2 30..40 <- B1 B2 -> B3 B2\n"
+     "B3 50..60 <- B2 -> B4 B1\n"
+     "B4 70..70 <- B3 ->\n"
+     "loop B1: B1 B3 B2\n"
+     "loop B2: B2"},
+    {"unreachable block",
+     {"10 LET a = 1", "20 GOTO 50", "30 PRINT a", "40 LET a = 2",
+      "50 PRINT a", "60 END"},
+     "B0 10..20 -> B2\n"
+     "B1 30..40 -> B2\n"
+     "B2 50..60 <- B0 B1 ->"},
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  QTextStream err(stderr);
+
+  static const QMap<BasicInterpreter::Engine, QString> engines{
+      {BasicInterpreter::PostfixEngine, "postfix"},
+      {BasicInterpreter::BytecodeEngine, "bytecode"}};
+  int failures = 0;
+  for (const Case &test : cases) {
+    Result tree = run(test, BasicInterpreter::TreeEngine);
+    if (tree.output != test.expected) {
+      err << "FAIL " << test.name << ": the tree engine printed\n"
+          << tree.output << "instead of\n"
+          << test.expected;
+      failures++;
+    }
+    for (auto engine = engines.constBegin(); engine != engines.constEnd();
+         engine++) {
+      Result other = run(test, engine.key());
+      if (other == tree) continue;
+      err << "FAIL " << test.name << ": " << engine.value()
+          << " differs from tree\n--- tree\n"
+          << describe(tree) << "--- " << engine.value() << "\n"
+          << describe(other);
+      failures++;
+    }
+  }
+  for (const ControlFlowCase &test : controlFlowCases) {
+    QString dump = controlFlow(test);
+    if (dump == test.expected) continue;
+    err << "FAIL " << test.name << ": the control flow is\n"
+        << dump << "\ninstead of\n"
+        << test.expected << "\n";
+    failures++;
+  }
+  err << cases.size() + controlFlowCases.size() << " programs, "
+      << failures << " failures\n";
+  return failures ? 1 : 0;
+}
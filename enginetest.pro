@@ -0,0 +1,11 @@
+TARGET = enginetest
+
+QT = core gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(core.pri)
+
+SOURCES += \
+    enginetest.cpp
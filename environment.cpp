@@ -1,40 +1,129 @@
 #include "environment.h"
 
+int Environment::getSlot(const QString &variable) {
+  auto i = index.constFind(variable);
+  if (i != index.constEnd()) return i.value();
+  values.push_back(BasicValue());
+  names.push_back(variable);
+  index[variable] = values.size() - 1;
+  return values.size() - 1;
+}
+
+QString Environment::getName(int slot) const { return names[slot]; }
+
+int Environment::getIntValue(int slot) const {
+  if (!values[slot].defined)
+    throw QStringException(names[slot] +
+                           " does not exist in runtime environment");
+  return values[slot].intVal;
+}
+
+QString Environment::getStrValue(int slot) const {
+  if (!values[slot].defined)
+    throw QStringException(names[slot] +
+                           " does not exist in runtime environment");
+  return values[slot].strVal;
+}
+
+VariableType Environment::getType(int slot) const {
+  return values[slot].type;
+}
+
 int Environment::getIntValue(const QString &variable) const {
-  if (!env.contains(variable))
+  if (!contains(variable))
     throw QStringException(variable + " does not exist in runtime environment");
-  return env[variable].intVal;
+  return getIntValue(index[variable]);
 }
 
 QString Environment::getStrValue(const QString &variable) const {
-  if (!env.contains(variable))
+  if (!contains(variable))
     throw QStringException(variable + " does not exist in runtime environment");
-  return env[variable].strVal;
+  return getStrValue(index[variable]);
 }
 
 VariableType Environment::getType(const QString &variable) const {
-  return env[variable].type;
+  auto i = index.constFind(variable);
+  if (i == index.constEnd()) return INT;
+  return getType(i.value());
+}
+
+bool Environment::contains(int slot) const { return values[slot].defined; }
+
+bool Environment::contains(const QString &variable) const {
+  auto i = index.constFind(variable);
+  return i != index.constEnd() && contains(i.value());
+}
+
+void Environment::setValue(int slot, int value) {
+  BasicValue &v = values[slot];
+  v.intVal = value;
+  v.type = INT;
+  v.defined = true;
+  invalidate(slot);
+  markDirty(slot);
+}
+
+void Environment::setValue(int slot, const QString &value) {
+  BasicValue &v = values[slot];
+  v.strVal = value;
+  v.type = STR;
+  v.defined = true;
+  invalidate(slot);
+  markDirty(slot);
 }
 
 void Environment::setValue(const QString &variable, int value) {
-  env[variable].intVal = value;
-  env[variable].type = INT;
+  setValue(getSlot(variable), value);
 }
 
 void Environment::setValue(const QString &variable, const QString &value) {
-  env[variable].strVal = value;
-  env[variable].type = STR;
+  setValue(getSlot(variable), value);
+}
+
+void Environment::clear(bool report) {
+  for (int slot = 0; slot < values.size(); slot++) {
+    if (!values[slot].defined) continue;
+    if (report) markDirty(slot);
+    values[slot] = BasicValue();
+    values[slot].dirty = report;
+  }
+  if (!report) dirty.clear();
+  for (Temporary &temporary : temporaries) temporary.valid = false;
 }
 
-void Environment::clear() { env.clear(); }
+int Environment::addTemporary(const QVector<int> &sources) {
+  temporaries.push_back(Temporary());
+  if (dependents.size() < values.size()) dependents.resize(values.size());
+  for (int slot : sources) dependents[slot].push_back(temporaries.size() - 1);
+  return temporaries.size() - 1;
+}
+
+void Environment::clearTemporaries() {
+  temporaries.clear();
+  dependents.clear();
+}
+
+QVector<VariableState> Environment::takeChanges() {
+  QVector<VariableState> changes;
+  changes.reserve(dirty.size());
+  for (int slot : dirty) {
+    BasicValue &v = values[slot];
+    v.dirty = false;
+    QString value = v.type == INT ? QString::number(v.intVal)
+                                  : "\"" + v.strVal + "\"";
+    changes.push_back(VariableState{names[slot], v.type, value, v.defined});
+  }
+  dirty.clear();
+  return changes;
+}
 
 QString Environment::toString() const {
   QString s;
-  for (auto i = env.constBegin(); i != env.constEnd(); i++) {
-    if (i.value().type == INT)
-      s += i.key() + ": INT = " + QString::number(i.value().intVal);
-    if (i.value().type == STR)
-      s += i.key() + ": STR = \"" + i.value().strVal + "\"";
+  for (auto i = index.constBegin(); i != index.constEnd(); i++) {
+    const BasicValue &v = values[i.value()];
+    if (!v.defined) continue;
+    if (v.type == INT) s += i.key() + ": INT = " + QString::number(v.intVal);
+    if (v.type == STR) s += i.key() + ": STR = \"" + v.strVal + "\"";
     s += "\n";
   }
   return s;
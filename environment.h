@@ -3,10 +3,13 @@
 
 #include <QMap>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 
 #include "basicinterpreter.h"
 #include "declarations.h"
 #include "expression.h"
+#include "program.h"
 #include "statement.h"
 
 /*
@@ -14,32 +17,112 @@
  * ------------------
  * This subclass stores runtime environment of a program
  * (current executing line, variable values)
+ * Every variable name is resolved to a slot once at parse time,
+ * values are stored in a vector indexed by slot.
+ * Subexpressions hoisted out of loops keep their values in temporaries.
  */
 class Environment {
  private:
   struct BasicValue {
-    int intVal;
+    int intVal = 0;
     QString strVal;
-    VariableType type;
+    VariableType type = INT;
+    bool defined = false;
+    bool dirty = false;
   };
 
-  QMap<QString, BasicValue> env;
+  // the virtual machine reads and writes slots directly
+  friend class VirtualMachine;
+
+  QVector<BasicValue> values;
+
+  // name of each slot
+  QStringList names;
+
+  // name -> slot, only used for resolving and toString
+  QMap<QString, int> index;
+
+  // slots changed since the last takeChanges
+  QVector<int> dirty;
+
+  void markDirty(int slot) {
+    if (values[slot].dirty) return;
+    values[slot].dirty = true;
+    dirty.push_back(slot);
+  }
+
+ public:
+  /*
+   * Struct: Temporary
+   * -----------------
+   * A hidden value computed from some variables, kept until one of them
+   * is assigned. Temporaries have no name, so toString and takeChanges
+   * never show them.
+   */
+  struct Temporary {
+    int value = 0;
+    bool valid = false;
+  };
+
+ private:
+  // expressions fill temporaries while they are evaluated
+  mutable QVector<Temporary> temporaries;
+
+  // temporaries computed from each slot, by slot
+  QVector<QVector<int>> dependents;
+
+  // drop the temporaries computed from slot
+  void invalidate(int slot) {
+    if (slot >= dependents.size()) return;
+    for (int temporary : dependents[slot])
+      temporaries[temporary].valid = false;
+  }
 
  public:
   Environment() = default;
-  QMap<int, Statement *>::const_iterator currentLine;
+  Program::const_iterator currentLine;
+
+  // return the slot of a variable, a new slot is allocated if needed
+  int getSlot(const QString &variable);
+
+  // return the name of the variable stored in slot
+  QString getName(int slot) const;
 
   // return the value of a variable
+  int getIntValue(int slot) const;
+  QString getStrValue(int slot) const;
+  VariableType getType(int slot) const;
   int getIntValue(const QString &variable) const;
   QString getStrValue(const QString &variable) const;
   VariableType getType(const QString &variable) const;
 
+  // return true if the variable has been set
+  bool contains(int slot) const;
+  bool contains(const QString &variable) const;
+
+  // return the variables changed since the last call
+  QVector<VariableState> takeChanges();
+
   // set the value of a variable
+  void setValue(int slot, int value);
+  void setValue(int slot, const QString &value);
   void setValue(const QString &variable, int value);
   void setValue(const QString &variable, const QString &value);
 
-  // clear the environment
-  void clear();
+  // clear the environment, slots stay resolved, unless report is set the
+  // cleared variables are not returned by takeChanges
+  void clear(bool report = true);
+
+  // allocate a temporary computed from the variables in sources
+  int addTemporary(const QVector<int> &sources);
+
+  // return a temporary, it may be filled even if the environment is const
+  Temporary &getTemporary(int temporary) const {
+    return temporaries[temporary];
+  }
+
+  // free every temporary
+  void clearTemporaries();
 
   // return string representation
   QString toString() const;
@@ -0,0 +1,83 @@
+#include "environmentmodel.h"
+
+#include <algorithm>
+
+EnvironmentModel::EnvironmentModel(QObject *parent)
+    : QAbstractTableModel(parent), timer(new QTimer(this)) {
+  // about 30 refreshes per second at most
+  timer->setSingleShot(true);
+  timer->setInterval(33);
+  connect(timer, &QTimer::timeout, this, &EnvironmentModel::refresh);
+}
+
+int EnvironmentModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : variables.size();
+}
+
+int EnvironmentModel::columnCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : 3;
+}
+
+QVariant EnvironmentModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+  const VariableState &v = variables[index.row()];
+  switch (index.column()) {
+    case 0:
+      return v.name;
+    case 1:
+      return v.type == INT ? "INT" : "STR";
+    default:
+      return v.value;
+  }
+}
+
+QVariant EnvironmentModel::headerData(int section, Qt::Orientation orientation,
+                                      int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+    return QVariant();
+  static const char *headers[] = {"Name", "Type", "Value"};
+  return headers[section];
+}
+
+void EnvironmentModel::clear() {
+  beginResetModel();
+  variables.clear();
+  pending.clear();
+  endResetModel();
+}
+
+void EnvironmentModel::setVisible(bool v) {
+  visible = v;
+  if (visible && !pending.isEmpty() && !timer->isActive()) timer->start();
+}
+
+void EnvironmentModel::update(QVector<VariableState> changes) {
+  for (const auto &change : changes) pending[change.name] = change;
+  if (visible && !timer->isActive()) timer->start();
+}
+
+void EnvironmentModel::refresh() {
+  if (!visible) return;
+  auto byName = [](const VariableState &v, const QString &name) {
+    return v.name < name;
+  };
+  for (const auto &change : pending) {
+    auto i = std::lower_bound(variables.begin(), variables.end(), change.name,
+                              byName);
+    int row = i - variables.begin();
+    bool exists = i != variables.end() && i->name == change.name;
+    if (exists && change.defined) {
+      *i = change;
+      emit dataChanged(index(row, 0), index(row, 2));
+    } else if (exists) {
+      beginRemoveRows(QModelIndex(), row, row);
+      variables.removeAt(row);
+      endRemoveRows();
+    } else if (change.defined) {
+      beginInsertRows(QModelIndex(), row, row);
+      variables.insert(row, change);
+      endInsertRows();
+    }
+  }
+  pending.clear();
+}
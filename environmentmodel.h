@@ -0,0 +1,58 @@
+#ifndef ENVIRONMENTMODEL_H
+#define ENVIRONMENTMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QTimer>
+#include <QVariant>
+#include <QVector>
+
+#include "declarations.h"
+
+/*
+ * Class: EnvironmentModel
+ * -----------------------
+ * This class shows the variables of the runtime environment as a table
+ * (name, type, value) sorted by name.
+ * Changed variables are queued and applied at most once per frame,
+ * and only while the view is visible.
+ */
+class EnvironmentModel : public QAbstractTableModel {
+  Q_OBJECT
+ public:
+  explicit EnvironmentModel(QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+  QVariant headerData(int section, Qt::Orientation orientation,
+                      int role = Qt::DisplayRole) const override;
+
+  // remove every variable
+  void clear();
+
+  // whether the view is shown, changes wait while it is hidden
+  void setVisible(bool visible);
+
+ public slots:
+  // queue changed variables for the next refresh
+  void update(QVector<VariableState> changes);
+
+ private:
+  // rows, sorted by name
+  QVector<VariableState> variables;
+
+  // name -> latest change not shown yet
+  QHash<QString, VariableState> pending;
+
+  // single shot, caps the refresh rate
+  QTimer *timer;
+
+  bool visible = true;
+
+  // apply the pending changes
+  void refresh();
+};
+
+#endif  // ENVIRONMENTMODEL_H
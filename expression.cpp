@@ -1,106 +1,75 @@
 #include "expression.h"
-Expression::Expression(QString exp) {
-  exp.remove(" ");
-  // return the precedence of an operator, -1 if not an operator
-  auto getPre = [](QString s) {
-    if (s == "**") return 3;
-    if (s == "(" || s == ")") return 2;
-    if (s == "*" || s == "/") return 1;
-    if (s == "+" || s == "-") return 0;
-    return -1;
-  };
-
-  // tokenize
-  // wrap the expression in a parenthesis can simplify parsing
-  exp.push_front("(");
-  exp.push_back(")");
-  // add a 0 before - to deal with negative number
-  int j = 0;
-  while ((j = exp.indexOf('-', j)) != -1) {
-    if (exp[j - 1] == '(') exp.insert(j, QString("0"));
-    ++j;
-  }
-  int i = 0, nexti = 0, length = exp.length();
-  QStringList tokens;
-  while (i < length) {
-    if (getPre(QString(exp[i])) >= 0) {
-      if (i < length - 1 && exp[i] == '*' && exp[i + 1] == '*') {
-        tokens.push_back("**");
-        i += 2;
-      } else
-        tokens.push_back(QString(exp[i++]));
-    } else {
-      nexti = i;
-      if (exp[i].isDigit()) {
-        // is constantf
-        while (exp[nexti].isDigit()) nexti++;
-        tokens.push_back(exp.mid(i, nexti - i));
-      } else {
-        // is variable
-        while (exp[nexti].isLetterOrNumber()) nexti++;
-        tokens.push_back(exp.mid(i, nexti - i));
-      }
-      if (i == nexti) throw QStringException("Invalid Expression!");
-      i = nexti;
+Expression::Expression(ExpressionPool &pool, const Lexer::Token *begin,
+                       const Lexer::Token *end)
+    : pool(&pool) {
+  root = parse(begin, end, 0);
+  // an unmatched ) or two operands in a row
+  if (begin != end) {
+    release(root);
+    throw QStringException("Invalid Expression!");
+  }
+  evaluated = retain(root);
+  flatten(root, 0);
+}
+
+Expression::~Expression() {
+  release(evaluated);
+  if (hoisted) release(hoisted);
+  release(root);
+  if (original) release(original);
+}
+
+Expression::Node *Expression::parse(const Lexer::Token *&token,
+                                    const Lexer::Token *end, int precedence) {
+  Node *left = parseOperand(token, end);
+  Operator op;
+  try {
+    while (token != end && toOperator(*token, op) &&
+           precedenceOf(op) >= precedence) {
+      token++;
+      // ** is right associative, the others are left associative
+      int next = op == POWER ? precedenceOf(op) : precedenceOf(op) + 1;
+      Node *right = parse(token, end, next);
+      left = makeCompound(op, left, right);
     }
+  } catch (const QStringException &) {
+    release(left);
+    throw;
   }
+  return left;
+}
 
-  // parse
-  QStack<QString> operators;
-  QStack<Node *> operands;
-
-  for (const QString &token : tokens) {
-    if (getPre(token) >= 0) {
-      // current token is an operator or a parenthesis
-      QString op = token;
-      QString top;
-      Node *node;
-      if (op == ")") {
-        if (operators.indexOf("(") == -1)
-          throw QStringException("Invalid Expression!");
-        while (!operators.empty() && (top = operators.pop()) != "(") {
-          node = new CompoundNode(top);
-          if (operands.size() < 2)
-            throw QStringException("Invalid Expression!");
-          node->right = operands.pop();
-          node->left = operands.pop();
-          operands.push(node);
-        }
-      } else if (op == "(")
-        operators.push("(");
-      else {
-        while (!operators.empty() && operators.top() != "(" && op != "**" &&
-               getPre(operators.top()) >= getPre(op)) {
-          top = operators.pop();
-          node = new CompoundNode(top);
-          if (operands.size() < 2)
-            throw QStringException("Invalid Expression!");
-          node->right = operands.pop();
-          node->left = operands.pop();
-          operands.push(node);
-        }
-        operators.push(op);
-      }
-    } else {
-      // current token is a constant or an identifier
-      Node *node;
-      if (token[0].isDigit())
-        node = new ConstantNode(token);
-      else if (token[0].isLetter())
-        node = new IdentifierNode(token);
-      operands.push(node);
+Expression::Node *Expression::parseOperand(const Lexer::Token *&token,
+                                           const Lexer::Token *end) {
+  if (token == end) throw QStringException("Invalid Expression!");
+  const Lexer::Token &t = *token++;
+  if (t.type == Lexer::INTEGER) return constant(Lexer::toInt(t.text));
+  if (t.type == Lexer::IDENTIFIER) return identifier(t.text);
+  if (t.is(u"(")) {
+    Node *node = parse(token, end, 0);
+    if (token == end || !token->is(u")")) {
+      release(node);
+      throw QStringException("Invalid Expression!");
     }
+    token++;
+    return node;
   }
-  if (!operators.empty() || operands.size() != 1)
-    throw QStringException("Invalid Expression!");
-  root = operands.pop();
+  // -x is kept as 0 - x, so the tree and the compilers only know
+  // binary operators
+  if (t.is(u"-")) {
+    Node *operand = parse(token, end, UNARY_PRECEDENCE);
+    return makeCompound(MINUS, constant(0), operand);
+  }
+  if (t.is(u"+")) return parse(token, end, UNARY_PRECEDENCE);
+  throw QStringException("Invalid Expression!");
 }
+
 QString Expression::toString() const { return QString(); }
 
-QString Expression::toTree() const {
+QString Expression::toTree(bool optimized) const {
   QStringList tree;
   QList<Node *> nodes;
-  nodes.push_back(root);
+  nodes.push_back(optimized || !original ? root : original);
   int level = 0;
   while (!nodes.isEmpty()) {
     level++;
@@ -120,6 +89,11 @@ QString Expression::toTree() const {
           next.push_back(p->left);
           next.push_back(p->right);
           break;
+        case COMMON:
+        case REUSE:
+        case HOISTED:
+          // root and original are never rewritten this way
+          break;
       }
       tree.push_back(s);
     }
@@ -128,55 +102,639 @@ QString Expression::toTree() const {
   return tree.join("\n");
 }
 
-Expression::~Expression() { delete root; }
-
 int Expression::eval(const Environment &context) const {
-  return root->eval(context);
+  return evaluated->eval(context);
+}
+
+void Expression::resolve(Environment &env) {
+  evaluated->resolve(env);
+  int i = 0;
+  for (auto &term : postfix)
+    if (term.type == PUSH_VARIABLE)
+      term.value = env.getSlot(postfixVariables[i++]);
+}
+
+void Expression::optimize() {
+  if (original) return;
+  original = root;
+  root = simplify(original);
+  release(evaluated);
+  evaluated = retain(root);
+  postfix.clear();
+  postfixVariables.clear();
+  commons.clear();
+  stackDepth = 0;
+  flatten(root, 0);
+}
+
+void Expression::eliminateCommon(const QVector<Expression *> &expressions) {
+  // count the compound subtrees in evaluation order, a subtree met again
+  // would be reused as a whole, so its own subtrees are not counted twice
+  QHash<Node *, int> uses;
+  QVector<Node *> pending;
+  for (Expression *exp : expressions) {
+    pending.append(exp->hoisted ? exp->hoisted : exp->root);
+    while (!pending.isEmpty()) {
+      Node *node = pending.takeLast();
+      if (node->type != COMPOUND || uses[node]++) continue;
+      // the left operand is evaluated first
+      pending.append(node->right);
+      pending.append(node->left);
+    }
+  }
+  QSet<Node *> common;
+  for (auto i = uses.constBegin(); i != uses.constEnd(); i++)
+    if (i.value() > 1) common.insert(i.key());
+
+  QHash<Node *, CommonNode *> made;
+  for (Expression *exp : expressions) {
+    Node *tree = exp->hoisted ? exp->hoisted : exp->root;
+    tree = common.isEmpty() ? exp->retain(tree)
+                            : exp->shareCommon(tree, common, made);
+    exp->release(exp->evaluated);
+    if (tree == exp->evaluated) continue;
+    exp->evaluated = tree;
+    exp->postfix.clear();
+    exp->postfixVariables.clear();
+    exp->commons.clear();
+    exp->stackDepth = 0;
+    exp->flatten(exp->evaluated, 0);
+  }
+}
+
+Expression::Node *Expression::shareCommon(Node *node,
+                                          const QSet<Node *> &common,
+                                          QHash<Node *, CommonNode *> &made) {
+  if (node->type != COMPOUND) return retain(node);
+  if (CommonNode *first = made.value(node)) {
+    retain(first);
+    Node *reuse = new ReuseNode(first);
+    reuse->refs.storeRelaxed(1);
+    return reuse;
+  }
+
+  Node *left = shareCommon(node->left, common, made);
+  Node *right = shareCommon(node->right, common, made);
+  Node *shared;
+  if (left == node->left && right == node->right) {
+    release(left);
+    release(right);
+    shared = retain(node);
+  } else {
+    // a copy private to the statement, so it is not interned
+    shared = newCompound(static_cast<CompoundNode *>(node)->op, left, right);
+    shared->refs.storeRelaxed(1);
+  }
+  if (!common.contains(node)) return shared;
+
+  auto *first = new CommonNode(shared);
+  first->refs.storeRelaxed(1);
+  made.insert(node, first);
+  return first;
+}
+
+void Expression::hoistInvariants(const QVector<Expression *> &expressions,
+                                 const QSet<int> *assigned, Environment &env) {
+  QHash<Node *, Node *> made;
+  bool changed = false;
+  for (Expression *exp : expressions) {
+    Node *tree = nullptr;
+    if (assigned) {
+      tree = exp->hoist(exp->root, *assigned, env, made);
+      if (tree == exp->root) {
+        exp->release(tree);
+        tree = nullptr;
+      }
+    }
+    if (!tree && !exp->hoisted) continue;
+    if (exp->hoisted) exp->release(exp->hoisted);
+    exp->hoisted = tree;
+    changed = true;
+  }
+  if (!changed) return;
+
+  eliminateCommon(expressions);
+  // the nodes copied by the rewrite are not resolved yet
+  for (Expression *exp : expressions) exp->resolve(env);
+}
+
+Expression::Node *Expression::hoist(Node *node, const QSet<int> &assigned,
+                                    Environment &env,
+                                    QHash<Node *, Node *> &made) {
+  if (node->type != COMPOUND) return retain(node);
+  if (Node *done = made.value(node)) return retain(done);
+
+  Node *result;
+  QVector<int> reads;
+  if (isInvariant(node, assigned, reads) && !reads.isEmpty()) {
+    result = new HoistedNode(retain(node), env.addTemporary(reads));
+  } else {
+    Node *left = hoist(node->left, assigned, env, made);
+    Node *right = hoist(node->right, assigned, env, made);
+    if (left == node->left && right == node->right) {
+      release(left);
+      release(right);
+      return retain(node);
+    }
+    // a copy private to the statement, so it is not interned
+    result = newCompound(static_cast<CompoundNode *>(node)->op, left, right);
+  }
+  result->refs.storeRelaxed(1);
+  made.insert(node, result);
+  return result;
+}
+
+bool Expression::isInvariant(Node *node, const QSet<int> &assigned,
+                             QVector<int> &reads) {
+  switch (node->type) {
+    case CONSTANT:
+      return true;
+    case IDENTIFIER:
+      if (assigned.contains(node->getSlot())) return false;
+      if (!reads.contains(node->getSlot())) reads.append(node->getSlot());
+      return true;
+    case COMPOUND:
+      return isInvariant(node->left, assigned, reads) &&
+             isInvariant(node->right, assigned, reads);
+    default:
+      // hoisting starts from root, which is never rewritten
+      return false;
+  }
+}
+
+void Expression::flatten(Node *node, int depth) {
+  stackDepth = qMax(stackDepth, depth + 1);
+  switch (node->type) {
+    case CONSTANT:
+      postfix.push_back(Term{PUSH_CONSTANT, node->getConstant()});
+      break;
+    case IDENTIFIER:
+      postfix.push_back(Term{PUSH_VARIABLE, node->getSlot()});
+      postfixVariables.push_back(node->getVariable());
+      break;
+    case COMPOUND:
+      flatten(node->left, depth);
+      flatten(node->right, depth + 1);
+      postfix.push_back(
+          Term{APPLY, static_cast<CompoundNode *>(node)->op});
+      break;
+    case COMMON:
+      flatten(node->left, depth);
+      commons.push_back(static_cast<CommonNode *>(node));
+      postfix.push_back(Term{SAVE_COMMON, commons.size() - 1});
+      break;
+    case REUSE: {
+      auto *first = static_cast<CommonNode *>(node->left);
+      int i = commons.indexOf(first);
+      if (i == -1) {
+        commons.push_back(first);
+        i = commons.size() - 1;
+      }
+      postfix.push_back(Term{PUSH_COMMON, i});
+      break;
+    }
+    case HOISTED:
+      // the postfix form has no jumps, so it computes the value every time
+      flatten(node->left, depth);
+      break;
+  }
+}
+
+Expression::Node *Expression::simplify(Node *node) {
+  if (node->type != COMPOUND) return retain(node);
+
+  Operator op = static_cast<CompoundNode *>(node)->op;
+  Node *left = simplify(node->left), *right = simplify(node->right);
+  if (left->type == CONSTANT && right->type == CONSTANT) {
+    int lv = left->getConstant(), rv = right->getConstant();
+    // an operation that throws is left for the run time to report
+    bool fails =
+        (op == DIVIDE && rv == 0) || (op == POWER && lv == 0 && rv < 0);
+    if (!fails) {
+      release(left);
+      release(right);
+      return constant(calculate(op, lv, rv));
+    }
+  }
+
+  // identities, the dropped operand is always a constant
+  if (right->type == CONSTANT) {
+    int rv = right->getConstant();
+    if ((rv == 0 && (op == PLUS || op == MINUS)) ||
+        (rv == 1 && (op == MULTIPLY || op == DIVIDE || op == POWER))) {
+      release(right);
+      return left;
+    }
+  }
+  if (left->type == CONSTANT) {
+    int lv = left->getConstant();
+    if ((lv == 0 && op == PLUS) || (lv == 1 && op == MULTIPLY)) {
+      release(left);
+      return right;
+    }
+  }
+
+  // x*0 drops x, which is only correct if evaluating x cannot throw
+  if (op == MULTIPLY && ((right->type == CONSTANT && right->getConstant() == 0 &&
+                          isSafe(left)) ||
+                         (left->type == CONSTANT && left->getConstant() == 0 &&
+                          isSafe(right)))) {
+    release(left);
+    release(right);
+    return constant(0);
+  }
+
+  return makeCompound(op, left, right);
+}
+
+bool Expression::isSafe(Node *node) {
+  // a variable may be undefined or a string, a division or a power may
+  // divide by zero
+  if (node->type == IDENTIFIER) return false;
+  if (node->type == CONSTANT) return true;
+  Operator op = static_cast<CompoundNode *>(node)->op;
+  if (op == DIVIDE || op == POWER) return false;
+  return isSafe(node->left) && isSafe(node->right);
+}
+
+int Expression::evalPostfix(const Environment &context) const {
+  QVarLengthArray<int, 32> stack(stackDepth);
+  int *top = stack.data();
+  for (const auto &term : postfix) {
+    switch (term.type) {
+      case PUSH_CONSTANT:
+        *top++ = term.value;
+        break;
+      case PUSH_VARIABLE:
+        *top++ = valueOf(context, term.value);
+        break;
+      case APPLY: {
+        int rv = *--top;
+        int lv = *--top;
+        *top++ = calculate(Operator(term.value), lv, rv);
+        break;
+      }
+      case SAVE_COMMON:
+        commons[term.value]->value = top[-1];
+        break;
+      case PUSH_COMMON:
+        *top++ = commons[term.value]->value;
+        break;
+    }
+  }
+  return stack[0];
 }
 
 int Expression::IdentifierNode::eval(const Environment &env) const {
-  if (env.getType(variable) == STR)
+  return valueOf(env, slot);
+}
+
+int Expression::valueOf(const Environment &env, int slot) {
+  if (env.getType(slot) == STR)
     throw QStringException("expression contains's variable that has type STR");
-  return env.getIntValue(variable);
+  return env.getIntValue(slot);
 }
 
-Expression::IdentifierNode::IdentifierNode(const QString &token)
-    : variable(QString(token)) {
+Expression::IdentifierNode::IdentifierNode(QStringView name)
+    : variable(name.toString()) {
   type = IDENTIFIER;
 }
 
 QString Expression::IdentifierNode::getVariable() { return variable; }
 
+int Expression::IdentifierNode::getSlot() { return slot; }
+
+Expression::CommonNode::CommonNode(Node *node) : Node(node) {
+  type = COMMON;
+}
+
+int Expression::CommonNode::eval(const Environment &env) const {
+  return value = left->eval(env);
+}
+
+Expression::ReuseNode::ReuseNode(CommonNode *common) : Node(common) {
+  type = REUSE;
+}
+
+int Expression::ReuseNode::eval(const Environment & /* unused */) const {
+  return static_cast<const CommonNode *>(left)->value;
+}
+
+void Expression::ReuseNode::resolve(Environment & /* unused */) {}
+
+Expression::HoistedNode::HoistedNode(Node *node, int temporary)
+    : Node(node), temporary(temporary) {
+  type = HOISTED;
+}
+
+int Expression::HoistedNode::eval(const Environment &env) const {
+  Environment::Temporary &saved = env.getTemporary(temporary);
+  if (!saved.valid) {
+    // a throw leaves the temporary invalid, so the error comes again
+    saved.value = left->eval(env);
+    saved.valid = true;
+  }
+  return saved.value;
+}
+
 int Expression::ConstantNode::eval(const Environment & /* unused */) const {
   return value;
 }
 
-Expression::ConstantNode::ConstantNode(const QString &token)
-    : value(token.toInt()) {
-  type = CONSTANT;
-}
+Expression::ConstantNode::ConstantNode(int v) : value(v) { type = CONSTANT; }
 
 int Expression::ConstantNode::getConstant() { return value; }
 
 int Expression::CompoundNode::eval(const Environment &env) const {
   int lv = left->eval(env), rv = right->eval(env);
-  if (op == "**") return qPow(lv, rv);
-  if (op == "+") return lv + rv;
-  if (op == "-") return lv - rv;
-  if (op == "*") return lv * rv;
-  if (op == "/") return lv / rv;
+  return calculate(op, lv, rv);
+}
+
+int Expression::calculate(Operator op, int lv, int rv) {
+  switch (op) {
+    case PLUS:
+      return calculate<PLUS>(lv, rv);
+    case MINUS:
+      return calculate<MINUS>(lv, rv);
+    case MULTIPLY:
+      return calculate<MULTIPLY>(lv, rv);
+    case DIVIDE:
+      return calculate<DIVIDE>(lv, rv);
+    case POWER:
+      return calculate<POWER>(lv, rv);
+  }
   return 0;
 }
 
-Expression::CompoundNode::CompoundNode(const QString &c) : op(c) {
+Expression::CompoundNode::CompoundNode(Operator o, Node *left, Node *right)
+    : Node(left, right), op(o) {
   type = COMPOUND;
 }
 
-QString Expression::CompoundNode::getOperator() { return op; }
+QString Expression::CompoundNode::getOperator() {
+  static const char *names[] = {"+", "-", "*", "/", "**"};
+  return names[op];
+}
+
+template <Expression::Operator O>
+int Expression::calculate(int lv, int rv) {
+  // unsigned arithmetic so that overflow wraps around instead of being
+  // undefined
+  switch (O) {
+    case PLUS:
+      return int(unsigned(lv) + unsigned(rv));
+    case MINUS:
+      return int(unsigned(lv) - unsigned(rv));
+    case MULTIPLY:
+      return int(unsigned(lv) * unsigned(rv));
+    case DIVIDE:
+      return divide(lv, rv);
+    case POWER:
+      return power(lv, rv);
+  }
+  return 0;
+}
+
+template <Expression::Operator O>
+Expression::OperatorNode<O>::OperatorNode(Node *left, Node *right)
+    : CompoundNode(O, left, right) {}
+
+template <Expression::Operator O>
+int Expression::OperatorNode<O>::eval(const Environment &env) const {
+  int lv = left->eval(env), rv = right->eval(env);
+  return calculate<O>(lv, rv);
+}
+
+template <Expression::Operator O>
+Expression::VarConstNode<O>::VarConstNode(Node *left, Node *right)
+    : CompoundNode(O, left, right), value(right->getConstant()) {}
+
+template <Expression::Operator O>
+int Expression::VarConstNode<O>::eval(const Environment &env) const {
+  return calculate<O>(valueOf(env, slot), value);
+}
+
+template <Expression::Operator O>
+void Expression::VarConstNode<O>::resolve(Environment &env) {
+  Node::resolve(env);
+  slot = left->getSlot();
+}
+
+template <Expression::Operator O>
+Expression::VarVarNode<O>::VarVarNode(Node *left, Node *right)
+    : CompoundNode(O, left, right) {}
+
+template <Expression::Operator O>
+int Expression::VarVarNode<O>::eval(const Environment &env) const {
+  int lv = valueOf(env, leftSlot), rv = valueOf(env, rightSlot);
+  return calculate<O>(lv, rv);
+}
+
+template <Expression::Operator O>
+void Expression::VarVarNode<O>::resolve(Environment &env) {
+  Node::resolve(env);
+  leftSlot = left->getSlot();
+  rightSlot = right->getSlot();
+}
+
+template <Expression::Operator O>
+Expression::NodeConstNode<O>::NodeConstNode(Node *left, Node *right)
+    : CompoundNode(O, left, right), value(right->getConstant()) {}
+
+template <Expression::Operator O>
+int Expression::NodeConstNode<O>::eval(const Environment &env) const {
+  return calculate<O>(left->eval(env), value);
+}
+
+int Expression::divide(int lv, int rv) {
+  if (rv == 0) throw QStringException("Division by zero");
+  // the only quotient that does not fit, the hardware traps on it
+  if (rv == -1) return int(0u - unsigned(lv));
+  return lv / rv;
+}
+
+int Expression::power(int base, int exponent) {
+  if (exponent < 0) {
+    if (base == 0) throw QStringException("Division by zero");
+    if (base == 1) return 1;
+    if (base == -1) return exponent % 2 ? -1 : 1;
+    return 0;
+  }
+  // unsigned arithmetic so that overflow is defined
+  unsigned result = 1, b = base;
+  for (unsigned e = exponent; e; e >>= 1) {
+    if (e & 1) result *= b;
+    b *= b;
+  }
+  return int(result);
+}
+
+template <int N>
+Expression::PowerNode<N>::PowerNode(Node *left, Node *right)
+    : CompoundNode(POWER, left, right) {}
+
+template <int N>
+int Expression::PowerNode<N>::eval(const Environment &env) const {
+  unsigned v = left->eval(env), result = v;
+  for (int i = 1; i < N; i++) result *= v;
+  return int(result);
+}
+
+template <Expression::Operator O>
+Expression::Node *Expression::newCompound(Node *left, Node *right) {
+  if (O == POWER && right->type == CONSTANT) {
+    if (right->getConstant() == 2) return new PowerNode<2>(left, right);
+    if (right->getConstant() == 3) return new PowerNode<3>(left, right);
+  }
+  if (left->type == IDENTIFIER && right->type == CONSTANT)
+    return new VarConstNode<O>(left, right);
+  if (left->type == IDENTIFIER && right->type == IDENTIFIER)
+    return new VarVarNode<O>(left, right);
+  if (right->type == CONSTANT) return new NodeConstNode<O>(left, right);
+  return new OperatorNode<O>(left, right);
+}
+
+bool Expression::toOperator(const Lexer::Token &token, Operator &op) {
+  if (token.type != Lexer::OPERATOR) return false;
+  switch (token.text[0].unicode()) {
+    case '+':
+      op = PLUS;
+      return true;
+    case '-':
+      op = MINUS;
+      return true;
+    case '*':
+      op = token.text.size() == 2 ? POWER : MULTIPLY;
+      return true;
+    case '/':
+      op = DIVIDE;
+      return true;
+  }
+  return false;
+}
+
+int Expression::precedenceOf(Operator op) {
+  switch (op) {
+    case PLUS:
+    case MINUS:
+      return 1;
+    case MULTIPLY:
+    case DIVIDE:
+      return 2;
+    case POWER:
+      break;
+  }
+  return 4;
+}
+
+Expression::Node *Expression::newCompound(Operator op, Node *left,
+                                          Node *right) {
+  switch (op) {
+    case PLUS:
+      return newCompound<PLUS>(left, right);
+    case MINUS:
+      return newCompound<MINUS>(left, right);
+    case MULTIPLY:
+      return newCompound<MULTIPLY>(left, right);
+    case DIVIDE:
+      return newCompound<DIVIDE>(left, right);
+    case POWER:
+      break;
+  }
+  return newCompound<POWER>(left, right);
+}
 
-Expression::CompoundNode::~CompoundNode() {
-  if (left) delete left;
-  if (right) delete right;
+Expression::Node *Expression::constant(int value) {
+  return pool->intern(
+      ExpressionPool::Key{CONSTANT, value, {}, nullptr, nullptr},
+      [value]() { return new ConstantNode(value); });
+}
+
+Expression::Node *Expression::identifier(QStringView name) {
+  return pool->intern(ExpressionPool::Key{IDENTIFIER, 0, name, nullptr,
+                                          nullptr},
+                      [name]() { return new IdentifierNode(name); });
+}
+
+Expression::Node *Expression::makeCompound(Operator op, Node *left,
+                                           Node *right) {
+  bool made = false;
+  Node *node =
+      pool->intern(ExpressionPool::Key{COMPOUND, op, {}, left, right}, [&]() {
+        made = true;
+        return newCompound(op, left, right);
+      });
+  if (!made) {
+    // the shared node already holds its operands, so these references
+    // are never the last ones
+    left->refs.deref();
+    right->refs.deref();
+  }
+  return node;
+}
+
+Expression::Node *Expression::retain(Node *node) {
+  node->refs.ref();
+  return node;
+}
+
+void Expression::release(Node *node) {
+  // operands are released iteratively, a long chain could be deep
+  QVarLengthArray<Node *, 32> unused;
+  unused.append(node);
+  while (!unused.isEmpty()) {
+    node = unused.last();
+    unused.removeLast();
+    if (node->refs.deref()) continue;
+    // a lookup may have interned a new node under the key meanwhile
+    ExpressionPool::Key key = ExpressionPool::keyOf(node);
+    ExpressionPool::Shard &shard = pool->shardOf(key);
+    {
+      QMutexLocker locker(&shard.mutex);
+      auto i = shard.nodes.find(key);
+      if (i != shard.nodes.end() && i.value() == node) shard.nodes.erase(i);
+    }
+    if (node->left) unused.append(node->left);
+    if (node->right) unused.append(node->right);
+    delete node;
+  }
+}
+
+ExpressionPool::~ExpressionPool() {
+  for (Shard &shard : shards)
+    for (Expression::Node *node : shard.nodes) delete node;
+}
+
+int ExpressionPool::size() {
+  int n = 0;
+  for (Shard &shard : shards) {
+    QMutexLocker locker(&shard.mutex);
+    n += shard.nodes.size();
+  }
+  return n;
+}
+
+ExpressionPool::Key ExpressionPool::keyOf(const Expression::Node *node) {
+  switch (node->type) {
+    case Expression::CONSTANT:
+      return Key{node->type,
+                 static_cast<const Expression::ConstantNode *>(node)->value,
+                 {}, nullptr, nullptr};
+    case Expression::IDENTIFIER:
+      return Key{node->type, 0,
+                 static_cast<const Expression::IdentifierNode *>(node)->variable,
+                 nullptr, nullptr};
+    case Expression::COMMON:
+    case Expression::REUSE:
+    case Expression::HOISTED:
+      // private to a statement, the key matches no interned node
+      return Key{node->type, 0, {}, node->left, nullptr};
+    case Expression::COMPOUND:
+      break;
+  }
+  return Key{node->type,
+             static_cast<const Expression::CompoundNode *>(node)->op, {},
+             node->left, node->right};
 }
 
 Expression::Node::Node(Expression::Node *left, Expression::Node *right)
@@ -187,3 +745,14 @@ int Expression::Node::getConstant() { return 0; }
 QString Expression::Node::getVariable() { return ""; }
 
 QString Expression::Node::getOperator() { return ""; }
+
+int Expression::Node::getSlot() { return -1; }
+
+void Expression::Node::resolve(Environment &env) {
+  if (left) left->resolve(env);
+  if (right) right->resolve(env);
+}
+
+void Expression::IdentifierNode::resolve(Environment &env) {
+  slot = env.getSlot(variable);
+}
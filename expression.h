@@ -1,15 +1,23 @@
 #ifndef EXPRESSION_H
 #define EXPRESSION_H
 
+#include <QAtomicInt>
 #include <QDebug>
+#include <QHash>
 #include <QList>
-#include <QStack>
+#include <QMutex>
+#include <QSet>
 #include <QString>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <QVector>
 #include <QtMath>
+#include <climits>
 #include <exception>
 
 #include "basicinterpreter.h"
 #include "environment.h"
+#include "lexer.h"
 #include "qstringexception.h"
 #include "statement.h"
 #include "declarations.h"
@@ -19,10 +27,18 @@
  * -----------------
  * This class is used to represent an expression Tree.
  * It contains three types of node: constant, identifier, compound
+ * Nodes are interned in an ExpressionPool, so a subtree that appears in
+ * several expressions, or twice in one, is a single shared node.
  */
 class Expression {
  private:
-  enum NodeType { CONSTANT, IDENTIFIER, COMPOUND };
+  // the bytecode compiler walks the tree directly
+  friend class Bytecode;
+  friend class ExpressionPool;
+
+  // COMMON and REUSE only appear in the trees rewritten by eliminateCommon,
+  // HOISTED in those rewritten by hoistInvariants
+  enum NodeType { CONSTANT, IDENTIFIER, COMPOUND, COMMON, REUSE, HOISTED };
 
   /*
    * Class: Node
@@ -33,12 +49,17 @@ class Expression {
    public:
     NodeType type;
     Node *left, *right;
+    // expressions and parent nodes using the node, once it drops to 0
+    // the node is being deleted and lookups in the pool skip it
+    QAtomicInt refs = 0;
     explicit Node(Node *left = nullptr, Node *right = nullptr);
+    virtual ~Node() = default;
     virtual int eval(const Environment &context) const = 0;
     virtual int getConstant();
     virtual QString getVariable();
     virtual QString getOperator();
-    virtual ~Node() = default;
+    virtual int getSlot();
+    virtual void resolve(Environment &env);
   };
 
   /*
@@ -50,9 +71,8 @@ class Expression {
    public:
     int value = 0;
     int eval(const Environment &env) const override;
-    explicit ConstantNode(const QString &token);
+    explicit ConstantNode(int v);
     int getConstant() override;
-    ~ConstantNode() = default;
   };
 
   /*
@@ -63,12 +83,17 @@ class Expression {
   class IdentifierNode : public Node {
    public:
     QString variable;
+    int slot = -1;
     int eval(const Environment &env) const override;
-    explicit IdentifierNode(const QString &token);
+    explicit IdentifierNode(QStringView name);
     QString getVariable() override;
-    ~IdentifierNode() = default;
+    int getSlot() override;
+    void resolve(Environment &env) override;
   };
 
+  // operators are decoded once when the tree is built
+  enum Operator { PLUS, MINUS, MULTIPLY, DIVIDE, POWER };
+
   /*
    * Class: CompoundNode
    * -------------------
@@ -76,27 +101,387 @@ class Expression {
    */
   class CompoundNode : public Node {
    public:
-    QString op;
+    Operator op;
     int eval(const Environment &env) const override;
-    explicit CompoundNode(const QString &c);
+    CompoundNode(Operator o, Node *left, Node *right);
     QString getOperator() override;
-    ~CompoundNode();
   };
 
+  /*
+   * Class: OperatorNode
+   * -------------------
+   * Compound nodes specialised by operator, so eval has no dispatch on op.
+   */
+  template <Operator O>
+  class OperatorNode : public CompoundNode {
+   public:
+    OperatorNode(Node *left, Node *right);
+    int eval(const Environment &env) const override;
+  };
+
+  /*
+   * Class: VarConstNode
+   * -------------------
+   * Specialised compound node for "variable op constant", e.g. I + 1
+   */
+  template <Operator O>
+  class VarConstNode : public CompoundNode {
+   public:
+    int slot = -1, value;
+    VarConstNode(Node *left, Node *right);
+    int eval(const Environment &env) const override;
+    void resolve(Environment &env) override;
+  };
+
+  /*
+   * Class: VarVarNode
+   * -----------------
+   * Specialised compound node for "variable op variable", e.g. N * N
+   */
+  template <Operator O>
+  class VarVarNode : public CompoundNode {
+   public:
+    int leftSlot = -1, rightSlot = -1;
+    VarVarNode(Node *left, Node *right);
+    int eval(const Environment &env) const override;
+    void resolve(Environment &env) override;
+  };
+
+  /*
+   * Class: NodeConstNode
+   * --------------------
+   * Specialised compound node for "expression op constant", e.g. (A+B)*2
+   */
+  template <Operator O>
+  class NodeConstNode : public CompoundNode {
+   public:
+    int value;
+    NodeConstNode(Node *left, Node *right);
+    int eval(const Environment &env) const override;
+  };
+
+  /*
+   * Class: PowerNode
+   * ----------------
+   * Specialised compound node for "expression ** N" with a small constant N,
+   * e.g. X ** 2, evaluated by N - 1 multiplications.
+   */
+  template <int N>
+  class PowerNode : public CompoundNode {
+   public:
+    PowerNode(Node *left, Node *right);
+    int eval(const Environment &env) const override;
+  };
+
+  /*
+   * Class: CommonNode
+   * -----------------
+   * The first evaluation of a subexpression (left) that its statement
+   * computes more than once, the value is kept for the ReuseNodes.
+   * Common nodes belong to one statement and are never interned.
+   */
+  class CommonNode : public Node {
+   public:
+    mutable int value = 0;
+    explicit CommonNode(Node *node);
+    int eval(const Environment &env) const override;
+  };
+
+  /*
+   * Class: ReuseNode
+   * ----------------
+   * A later occurrence of a common subexpression, it reads the value its
+   * CommonNode(left) saved earlier in the same execution of the statement.
+   */
+  class ReuseNode : public Node {
+   public:
+    explicit ReuseNode(CommonNode *common);
+    int eval(const Environment &env) const override;
+    // the common node is resolved where it is evaluated
+    void resolve(Environment &env) override;
+  };
+
+  /*
+   * Class: HoistedNode
+   * ------------------
+   * A subexpression(left) that does not change inside the loop around its
+   * statement. Its value is kept in a temporary of the environment until
+   * one of its variables is assigned, so it is computed at its first use
+   * and then once per change, like a value computed before the loop but
+   * without running it earlier than the statement would.
+   */
+  class HoistedNode : public Node {
+   public:
+    int temporary;
+    HoistedNode(Node *node, int temporary);
+    int eval(const Environment &env) const override;
+  };
+
+  // apply an operator to two integers, + - * and ** wrap around on
+  // overflow like two's complement ints
+  template <Operator O>
+  static int calculate(int lv, int rv);
+  static int calculate(Operator op, int lv, int rv);
+
+  // read an integer variable, throw if it is undefined or a string
+  static int valueOf(const Environment &env, int slot);
+
+  // decode a binary operator token, return false if token is not one
+  static bool toOperator(const Lexer::Token &token, Operator &op);
+
+  // binding power of a binary operator, unary minus binds tighter than
+  // * and / but looser than **, so -X ** 2 is -(X ** 2)
+  static int precedenceOf(Operator op);
+  static const int UNARY_PRECEDENCE = 3;
+
+  // return the shared constant, variable or compound node, a new
+  // reference is returned, makeCompound takes over those of its operands
+  Node *constant(int value);
+  Node *identifier(QStringView name);
+  Node *makeCompound(Operator op, Node *left, Node *right);
+
+  // take another reference to node
+  Node *retain(Node *node);
+
+  // drop a reference to node, the node and then its operands are deleted
+  // once nothing uses them
+  void release(Node *node);
+
+  // parse operators binding at least as tight as precedence,
+  // token is moved past the tokens consumed
+  Node *parse(const Lexer::Token *&token, const Lexer::Token *end,
+              int precedence);
+
+  // parse a constant, a variable, a parenthesised or a unary expression
+  Node *parseOperand(const Lexer::Token *&token, const Lexer::Token *end);
+
+  // build the specialised compound node for O and the operand shapes
+  template <Operator O>
+  static Node *newCompound(Node *left, Node *right);
+  static Node *newCompound(Operator op, Node *left, Node *right);
+
+  /*
+   * Struct: Term
+   * ------------
+   * One entry of the postfix form: push a constant, push a variable
+   * (value is its slot), apply an operator to the two topmost values,
+   * save the topmost value for a common subexpression or push it again
+   * (value indexes commons).
+   */
+  enum TermType { PUSH_CONSTANT, PUSH_VARIABLE, APPLY, SAVE_COMMON,
+                  PUSH_COMMON };
+  struct Term {
+    TermType type;
+    int value;
+  };
+
+  // build the postfix form of node, whose result lands at stack[depth]
+  void flatten(Node *node, int depth);
+
+  // return a simplified copy of node with constant subtrees folded
+  Node *simplify(Node *node);
+
+  // whether evaluating node can never throw
+  static bool isSafe(Node *node);
+
+  // return node with every subtree in common replaced, the first one
+  // evaluated by a CommonNode and the later ones by ReuseNodes of it,
+  // made keeps the CommonNodes of the statement
+  Node *shareCommon(Node *node, const QSet<Node *> &common,
+                    QHash<Node *, CommonNode *> &made);
+
+  // return node with every largest compound subtree that reads variables,
+  // but none in assigned, replaced by a HoistedNode, made keeps the
+  // rewritten subtrees of the statement so shared ones stay shared
+  Node *hoist(Node *node, const QSet<int> &assigned, Environment &env,
+              QHash<Node *, Node *> &made);
+
+  // whether node reads no slot in assigned, the slots it reads are added
+  // to reads
+  static bool isInvariant(Node *node, const QSet<int> &assigned,
+                          QVector<int> &reads);
+
+  // the same expression flattened in postfix order
+  QVector<Term> postfix;
+
+  // name of each PUSH_VARIABLE term, in order
+  QStringList postfixVariables;
+
+  // common subexpressions used by SAVE_COMMON and PUSH_COMMON terms,
+  // a later expression of the statement reads those of an earlier one
+  QVector<const CommonNode *> commons;
+
+  // deepest value stack needed by the postfix form
+  int stackDepth = 0;
+
+  // where the nodes of the expression are interned
+  ExpressionPool *pool;
+
   Node *root = nullptr;
 
+  // the tree as written, only kept once the expression is optimised
+  Node *original = nullptr;
+
+  // root with its loop invariants hoisted, nullptr if there are none
+  Node *hoisted = nullptr;
+
+  // what eval walks: hoisted or root with its common subexpressions
+  // replaced, or that tree itself
+  Node *evaluated = nullptr;
+
  public:
-  explicit Expression(QString exp);
+  // parse the tokens of an expression, sharing nodes through pool
+  Expression(ExpressionPool &pool, const Lexer::Token *begin,
+             const Lexer::Token *end);
+  Expression(const Expression &) = delete;
+  Expression &operator=(const Expression &) = delete;
+  ~Expression();
 
   // evaluate the expression and return the result
   int eval(const Environment &context) const;
 
+  // integer base ** exponent by squaring, overflow wraps around like
+  // + - and * do in calculate, a negative exponent gives
+  // 1 / base ** -exponent truncated towards zero, throw if base is 0
+  static int power(int base, int exponent);
+
+  // lv / rv truncated towards zero, INT_MIN / -1 gives INT_MIN back
+  // instead of trapping, throw if rv is 0
+  static int divide(int lv, int rv);
+
+  // evaluate the postfix form, same result as eval
+  int evalPostfix(const Environment &context) const;
+
+  // bind every variable to its slot in env
+  void resolve(Environment &env);
+
+  // fold constant subtrees and simplify identities like x+0 and x*1,
+  // the original tree stays available to toTree
+  void optimize();
+
+  // compute each subexpression that the expressions of one statement
+  // evaluate more than once only once per execution, expressions have no
+  // side effects so the first value can be reused,
+  // expressions are given in the order they are evaluated, after optimize
+  static void eliminateCommon(const QVector<Expression *> &expressions);
+
+  // hoist the subexpressions that read variables, but none in assigned,
+  // out of the loop around the statement, assigned holds the slots the
+  // innermost loop writes, nullptr outside loops undoes any hoisting,
+  // expressions are those of one statement after resolve, as given to
+  // eliminateCommon
+  static void hoistInvariants(const QVector<Expression *> &expressions,
+                              const QSet<int> *assigned, Environment &env);
+
   // return the original statement
   QString toString() const;
 
-  // return the expression tree of the statement
-  QString toTree() const;
-  ~Expression();
+  // return the expression tree of the statement,
+  // either as written or after optimize
+  QString toTree(bool optimized = false) const;
+};
+
+/*
+ * Class: ExpressionPool
+ * ---------------------
+ * This class interns the nodes of expressions: a node is looked up by its
+ * type, value or name and its operands, which are interned themselves,
+ * so structurally identical subtrees are the same node.
+ * A node is counted by the expressions and nodes using it, and deleted
+ * with the last of them. Statements are parsed in parallel, so the nodes
+ * are spread over shards by the hash of their key, each with its own
+ * mutex, and the counts are atomic.
+ */
+class ExpressionPool {
+ public:
+  ExpressionPool() = default;
+  ExpressionPool(const ExpressionPool &) = delete;
+  ExpressionPool &operator=(const ExpressionPool &) = delete;
+
+  // every expression must be destroyed before its pool
+  ~ExpressionPool();
+
+  // number of distinct nodes in use
+  int size();
+
+ private:
+  friend class Expression;
+
+  /*
+   * Struct: Key
+   * -----------
+   * What makes two nodes identical, value is the constant or the
+   * operator, variable views the name held by the node.
+   */
+  struct Key {
+    int type;
+    int value;
+    QStringView variable;
+    const void *left, *right;
+
+    bool operator==(const Key &other) const {
+      return type == other.type && value == other.value &&
+             variable == other.variable && left == other.left &&
+             right == other.right;
+    }
+
+    friend uint qHash(const Key &key, uint seed = 0) {
+      uint h = qHash(key.variable, seed);
+      h = h * 31 + uint(key.type);
+      h = h * 31 + uint(key.value);
+      h = h * 31 + qHash(key.left, seed);
+      return h * 31 + qHash(key.right, seed);
+    }
+  };
+
+  static Key keyOf(const Expression::Node *node);
+
+  /*
+   * Struct: Shard
+   * -------------
+   * The nodes whose keys hash to the shard, guarded by its mutex.
+   */
+  struct Shard {
+    QHash<Key, Expression::Node *> nodes;
+    QMutex mutex;
+  };
+
+  static const int SHARDS = 64;
+  Shard shards[SHARDS];
+
+  Shard &shardOf(const Key &key) {
+    uint h = qHash(key);
+    return shards[(h ^ (h >> 16)) % SHARDS];
+  }
+
+  // return the node interned under key with one more reference, or the
+  // node returned by make if there is none or it is being deleted
+  template <class Make>
+  Expression::Node *intern(const Key &key, Make make);
 };
 
+template <class Make>
+Expression::Node *ExpressionPool::intern(const Key &key, Make make) {
+  Shard &shard = shardOf(key);
+  QMutexLocker locker(&shard.mutex);
+  Expression::Node *&node = shard.nodes[key];
+  // a count that reached 0 never goes up again
+  if (node)
+    for (int refs = node->refs.loadRelaxed(); refs > 0;
+         refs = node->refs.loadRelaxed())
+      if (node->refs.testAndSetOrdered(refs, refs + 1)) return node;
+
+  Expression::Node *made = make();
+  made->refs.storeRelaxed(1);
+  if (key.type != Expression::IDENTIFIER) {
+    node = made;
+    return made;
+  }
+  // the key has to view the name kept by the node, not the line, and
+  // assigning would keep the key of the node being deleted
+  shard.nodes.remove(key);
+  shard.nodes.insert(keyOf(made), made);
+  return made;
+}
+
 #endif  // EXPRESSION_H
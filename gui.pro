@@ -0,0 +1,32 @@
+TARGET = BasicInterpreter
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++17
+
+include(core.pri)
+
+SOURCES += \
+    environmentmodel.cpp \
+    guichannel.cpp \
+    main.cpp \
+    mainwindow.cpp
+
+HEADERS += \
+    environmentmodel.h \
+    guichannel.h \
+    mainwindow.h \
+    ringbuffer.h
+
+FORMS += \
+    mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+DISTFILES += \
+    basic0
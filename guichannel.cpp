@@ -0,0 +1,162 @@
+#include "guichannel.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+
+GuiChannel::GuiChannel(QObject *parent)
+    : QObject(parent), timer(new QTimer(this)) {
+  connect(timer, &QTimer::timeout, this, &GuiChannel::drain);
+  timer->start(16);
+}
+
+void GuiChannel::attach(BasicInterpreter *interpreter) {
+  // direct connections, the lambdas run on the interpreter's thread
+  using B = BasicInterpreter;
+  auto direct = Qt::DirectConnection;
+  connect(interpreter, &B::needInput, this, [this]() { push({INPUT}); },
+          direct);
+  connect(interpreter, &B::needLoad, this, [this]() { push({LOAD}); },
+          direct);
+  connect(interpreter, &B::needOutput, this,
+          [this](QString s) { push({OUTPUT, s}); }, direct);
+  connect(interpreter, &B::needPrintExpTree, this,
+          [this](QString s) { push({EXP_TREE, s}); }, direct);
+  connect(interpreter, &B::needUpdateEnv, this,
+          [this](QVector<VariableState> v) {
+            push({UPDATE_ENV, {}, {}, B::Normal, v});
+          },
+          direct);
+  connect(interpreter, &B::needPopUp, this,
+          [this](QString s) { push({POP_UP, s}); }, direct);
+  connect(interpreter, &B::needHighlight, this,
+          [this](QList<QPair<int, QColor>> l) { push({HIGHLIGHT, {}, l}); },
+          direct);
+  connect(interpreter, &B::modeChanged, this,
+          [this](B::Mode m) { push({MODE, {}, {}, m}); }, direct);
+  // the source is read here, the GUI thread must not touch the interpreter
+  connect(interpreter, &B::needClearScreen, this,
+          [this, interpreter]() {
+            push({CLEAR_SCREEN, interpreter->getSource()});
+          },
+          direct);
+  connect(interpreter, &B::sourceChanged, this,
+          [this, interpreter]() { push({SOURCE, interpreter->getSource()}); },
+          direct);
+  connect(interpreter, &B::loadProgress, this,
+          [this](qint64 done, qint64 total) {
+            Event event(PROGRESS);
+            event.done = done;
+            event.total = total;
+            push(event);
+          },
+          direct);
+  connect(interpreter, &B::loaded, this,
+          [this](int lines, qint64 elapsed) {
+            Event event(LOADED);
+            event.count = lines;
+            event.elapsed = elapsed;
+            push(event);
+          },
+          direct);
+}
+
+void GuiChannel::push(const Event &event) {
+  if (buffer.push(event)) return;
+
+  // drain wakes under the mutex, so it can't slip in between the retry
+  // and the wait; the timeout only serves to notice an interruption
+  QMutexLocker locker(&spaceMutex);
+  while (!buffer.push(event)) {
+    // the GUI is gone or about to go, drop the event
+    if (QThread::currentThread()->isInterruptionRequested()) return;
+    spaceFreed.wait(&spaceMutex, 100);
+  }
+}
+
+void GuiChannel::drain() {
+  if (draining) return;
+  draining = true;
+
+  // leave time for repaints and user input when the buffer stays full
+  QElapsedTimer elapsed;
+  elapsed.start();
+  Event event;
+  bool popped = false;
+  while (elapsed.elapsed() < 8 && buffer.pop(event)) {
+    if (!popped) {
+      popped = true;
+      // a full buffer may have put the interpreter to sleep
+      QMutexLocker locker(&spaceMutex);
+      spaceFreed.wakeAll();
+    }
+    switch (event.type) {
+      case OUTPUT:
+        output.append(event.text);
+        continue;
+      case UPDATE_ENV:
+        variables.append(event.variables);
+        continue;
+      case EXP_TREE:
+        tree = event.text;
+        treeChanged = true;
+        continue;
+      case HIGHLIGHT:
+        lines = event.lines;
+        linesChanged = true;
+        continue;
+      case PROGRESS:
+        done = event.done;
+        total = event.total;
+        progressChanged = true;
+        continue;
+      default:
+        break;
+    }
+
+    // everything else must be seen after what came before it
+    flush();
+    switch (event.type) {
+      case INPUT:
+        emit needInput();
+        break;
+      case LOAD:
+        emit needLoad();
+        break;
+      case CLEAR_SCREEN:
+        emit needClearScreen(event.text);
+        break;
+      case POP_UP:
+        emit needPopUp(event.text);
+        break;
+      case MODE:
+        emit modeChanged(event.mode);
+        break;
+      case SOURCE:
+        emit sourceChanged(event.text);
+        break;
+      case LOADED:
+        emit loaded(event.count, event.elapsed);
+        break;
+      default:
+        break;
+    }
+  }
+  flush();
+
+  draining = false;
+}
+
+void GuiChannel::flush() {
+  if (!output.isEmpty()) {
+    emit needOutput(output.join('\n'));
+    output.clear();
+  }
+  if (!variables.isEmpty()) {
+    emit needUpdateEnv(variables);
+    variables.clear();
+  }
+  if (treeChanged) emit needPrintExpTree(tree);
+  if (linesChanged) emit needHighlight(lines);
+  if (progressChanged) emit loadProgress(done, total);
+  treeChanged = linesChanged = progressChanged = false;
+}
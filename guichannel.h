@@ -0,0 +1,110 @@
+#ifndef GUICHANNEL_H
+#define GUICHANNEL_H
+
+#include <QColor>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "basicinterpreter.h"
+#include "ringbuffer.h"
+
+/*
+ * Class: GuiChannel
+ * -----------------
+ * This class carries the signals of an interpreter running on a worker
+ * thread to the GUI thread. They are queued in a RingBuffer and drained
+ * on a timer, so the interpreter never waits for a repaint.
+ * Consecutive outputs and variable changes are joined, only the latest
+ * highlight, exp tree and load progress of a drain are shown.
+ */
+class GuiChannel : public QObject {
+  Q_OBJECT
+ public:
+  explicit GuiChannel(QObject *parent = nullptr);
+
+  // forward the signals of interpreter, called on the GUI thread
+  // before the interpreter starts working
+  void attach(BasicInterpreter *interpreter);
+
+ signals:
+  // the same signals as BasicInterpreter, emitted on the GUI thread
+  void needInput();
+  void needLoad();
+  void needOutput(QString output);
+  void needPrintExpTree(QString tree);
+  void needClearScreen(QString source);
+  void needUpdateEnv(QVector<VariableState> changes);
+  void needPopUp(QString err);
+  void needHighlight(QList<QPair<int, QColor>> lines);
+  void modeChanged(BasicInterpreter::Mode mode);
+  void sourceChanged(QString source);
+  void loadProgress(qint64 done, qint64 total);
+  void loaded(int lines, qint64 elapsed);
+
+ private:
+  enum EventType {
+    INPUT,
+    LOAD,
+    OUTPUT,
+    EXP_TREE,
+    CLEAR_SCREEN,
+    UPDATE_ENV,
+    POP_UP,
+    HIGHLIGHT,
+    MODE,
+    SOURCE,
+    PROGRESS,
+    LOADED
+  };
+
+  struct Event {
+    EventType type;
+    QString text;
+    QList<QPair<int, QColor>> lines;
+    BasicInterpreter::Mode mode;
+    QVector<VariableState> variables;
+    int count = 0;
+    qint64 elapsed = 0, done = 0, total = 0;
+    Event(EventType t = OUTPUT, const QString &s = QString(),
+          const QList<QPair<int, QColor>> &l = {},
+          BasicInterpreter::Mode m = BasicInterpreter::Normal,
+          const QVector<VariableState> &v = {})
+        : type(t), text(s), lines(l), mode(m), variables(v) {}
+  };
+
+  RingBuffer<Event, 1024> buffer;
+  QTimer *timer;
+
+  // push sleeps on spaceFreed while the buffer is full, drain wakes it
+  QMutex spaceMutex;
+  QWaitCondition spaceFreed;
+
+  // a pop up runs a nested event loop, which must not drain again
+  bool draining = false;
+
+  // outputs and states collected by the current drain
+  QStringList output;
+  QVector<VariableState> variables;
+  QString tree;
+  QList<QPair<int, QColor>> lines;
+  qint64 done = 0, total = 0;
+  bool treeChanged = false, linesChanged = false, progressChanged = false;
+
+  // called on the worker thread, sleep while the buffer is full
+  void push(const Event &event);
+
+  // dispatch everything in the buffer, with a time budget
+  void drain();
+
+  // emit the collected outputs and states
+  void flush();
+};
+
+#endif  // GUICHANNEL_H
@@ -0,0 +1,65 @@
+#include "lexer.h"
+
+#include "qstringexception.h"
+
+Lexer::Lexer(QStringView line) {
+  const QChar *p = line.begin(), *end = line.end();
+  while (p < end) {
+    const QChar *start = p;
+    QChar c = *p++;
+    TokenType type;
+    if (c.isSpace())
+      continue;
+    else if (c.isDigit()) {
+      while (p < end && p->isDigit()) p++;
+      type = INTEGER;
+    } else if (c.isLetter()) {
+      while (p < end && p->isLetterOrNumber()) p++;
+      type = isKeyword(QStringView(start, p)) ? KEYWORD : IDENTIFIER;
+    } else if (c == '"' || c == '\'') {
+      // only the opening quote closes a string, so "it's" is a string
+      while (p < end && *p != c) p++;
+      if (p == end) throw QStringException("Unterminated string");
+      p++;
+      type = STRING;
+    } else if (c == '*' && p < end && *p == '*') {
+      p++;
+      type = OPERATOR;
+    } else if (QStringView(u"+-*/()=<>,").contains(c))
+      type = OPERATOR;
+    else
+      type = UNKNOWN;
+    tokens.append(Token{type, QStringView(start, p)});
+  }
+}
+
+int Lexer::indexOf(QStringView s, int from) const {
+  for (int i = from; i < tokens.size(); i++)
+    if (tokens[i].is(s)) return i;
+  return -1;
+}
+
+int Lexer::toInt(QStringView digits, bool *ok) {
+  qint64 value = 0;
+  for (QChar c : digits) {
+    value = value * 10 + c.digitValue();
+    if (value > INT_MAX) {
+      if (ok) *ok = false;
+      return 0;
+    }
+  }
+  if (ok) *ok = true;
+  return int(value);
+}
+
+QStringView Lexer::unquote(QStringView s) { return s.mid(1, s.size() - 2); }
+
+bool Lexer::isKeyword(QStringView s) {
+  static const QStringView keywords[] = {u"REM",    u"LET",  u"PRINT",
+                                         u"PRINTF", u"INPUT", u"INPUTS",
+                                         u"GOTO",   u"IF",   u"THEN",
+                                         u"END"};
+  for (QStringView keyword : keywords)
+    if (s == keyword) return true;
+  return false;
+}
@@ -0,0 +1,62 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <QChar>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <climits>
+
+/*
+ * Class: Lexer
+ * ------------
+ * This class splits a line into tokens in a single pass, the tokens are
+ * shared by every Statement::parse and the expression parser.
+ * A token is a view into the line, so the line must outlive the Lexer.
+ */
+class Lexer {
+ public:
+  enum TokenType { KEYWORD, IDENTIFIER, INTEGER, OPERATOR, STRING, UNKNOWN };
+
+  /*
+   * Struct: Token
+   * -------------
+   * A STRING keeps its quotes, an UNKNOWN is a character that starts no
+   * token.
+   */
+  struct Token {
+    TokenType type;
+    QStringView text;
+
+    // whether the token is the keyword or operator s
+    bool is(QStringView s) const {
+      return (type == KEYWORD || type == OPERATOR) && text == s;
+    }
+  };
+
+  // tokenize line, whitespace only separates tokens,
+  // throw if a string is not closed by the quote that opened it
+  explicit Lexer(QStringView line);
+
+  int size() const { return tokens.size(); }
+  const Token &operator[](int i) const { return tokens[i]; }
+  const Token *begin() const { return tokens.constData(); }
+  const Token *end() const { return tokens.constData() + tokens.size(); }
+
+  // return the index of the first keyword or operator s from from,
+  // -1 if there is none
+  int indexOf(QStringView s, int from = 0) const;
+
+  // convert the digits of an INTEGER, return 0 and set ok to false
+  // if it does not fit in an int, like QString::toInt
+  static int toInt(QStringView digits, bool *ok = nullptr);
+
+  // return the text of a STRING without its quotes
+  static QStringView unquote(QStringView s);
+
+ private:
+  QVarLengthArray<Token, 32> tokens;
+
+  static bool isKeyword(QStringView s);
+};
+
+#endif  // LEXER_H
@@ -1,5 +1,7 @@
 #include "mainwindow.h"
 
+#include <QFile>
+
 #include "ui_mainwindow.h"
 
 MainWindow::MainWindow(QWidget *parent)
@@ -9,14 +11,50 @@ MainWindow::MainWindow(QWidget *parent)
   connect(ui->loadButton, &QPushButton::clicked, this, &MainWindow::load);
   connect(ui->excuteButton, &QPushButton::clicked, this, &MainWindow::execute);
   connect(ui->clearButton, &QPushButton::clicked, this, &MainWindow::clear);
+  connect(ui->stopButton, &QPushButton::clicked, this, &MainWindow::stop);
   connect(ui->loadAction, &QAction::triggered, this, &MainWindow::load);
   connect(ui->runAction, &QAction::triggered, this, &MainWindow::execute);
   connect(ui->clearAction, &QAction::triggered, this, &MainWindow::clear);
   connect(ui->cmd, &QLineEdit::returnPressed, this, &MainWindow::getCMD);
 
+  ui->engineBox->addItem("Tree", BasicInterpreter::TreeEngine);
+  ui->engineBox->addItem("Postfix", BasicInterpreter::PostfixEngine);
+  ui->engineBox->addItem("Bytecode", BasicInterpreter::BytecodeEngine);
+  connect(ui->engineBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+          this, &MainWindow::selectEngine);
+  connect(ui->optimizedTreeBox, &QCheckBox::toggled, this,
+          &MainWindow::selectOptimizedTree);
+
   ui->output->setReadOnly(true);
   ui->output->installEventFilter(this);
 
+  envModel = new EnvironmentModel(this);
+  ui->environment->setModel(envModel);
+  ui->environment->verticalHeader()->hide();
+  ui->environment->horizontalHeader()->setStretchLastSection(true);
+  ui->environment->installEventFilter(this);
+
+  worker = new QThread(this);
+  worker->start();
+  channel = new GuiChannel(this);
+  connect(channel, &GuiChannel::needInput, this, &MainWindow::getInput);
+  connect(channel, &GuiChannel::needOutput, this, &MainWindow::print);
+  connect(channel, &GuiChannel::needLoad, this, &MainWindow::load);
+  connect(channel, &GuiChannel::needPrintExpTree, this,
+          &MainWindow::printExpTree);
+  connect(channel, &GuiChannel::needClearScreen, this,
+          &MainWindow::clearScreen);
+  connect(channel, &GuiChannel::needPopUp, this, &MainWindow::notifyError);
+  connect(channel, &GuiChannel::needHighlight, this, &MainWindow::HightLines);
+  connect(channel, &GuiChannel::needUpdateEnv, envModel,
+          &EnvironmentModel::update);
+  connect(channel, &GuiChannel::modeChanged, this, &MainWindow::detectMode);
+  connect(channel, &GuiChannel::sourceChanged, this,
+          &MainWindow::updateSource);
+  connect(channel, &GuiChannel::loadProgress, this,
+          &MainWindow::loadProgress);
+  connect(channel, &GuiChannel::loaded, this, &MainWindow::loadFinished);
+
   newInterpreter();
 }
 
@@ -28,52 +66,51 @@ bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
         ui->output->setReadOnly(true);
         QString input = ui->output->toPlainText();
         input = input.mid(input.lastIndexOf('?') + 1).simplified();
-        interpreter->setInput(input);
+        QMetaObject::invokeMethod(
+            interpreter, [i = interpreter, input]() { i->setInput(input); });
         ui->cmd->setFocus();
         return true;  // do not process this event further
       }
     }
     return false;  // process this event further
+  } else if (watched == ui->environment) {
+    if (event->type() == QEvent::Show) envModel->setVisible(true);
+    if (event->type() == QEvent::Hide) envModel->setVisible(false);
+    return false;
   } else {
     // pass the event on to the parent class
     return QMainWindow::eventFilter(watched, event);
   }
 }
 
-MainWindow::~MainWindow() { delete ui; }
+MainWindow::~MainWindow() {
+  // a running program ends at its next backward jump, and a
+  // producer waiting for a full channel gives up on interruption
+  interpreter->requestStop();
+  worker->requestInterruption();
+  worker->quit();
+  worker->wait();
+  delete interpreter;
+  delete ui;
+}
 
 void MainWindow::newInterpreter() {
   interpreter = new BasicInterpreter();
-  connect(interpreter, &BasicInterpreter::needInput, this,
-          &MainWindow::getInput);
-  connect(interpreter, &BasicInterpreter::needOutput, this, &MainWindow::print);
-  connect(interpreter, &BasicInterpreter::needLoad, this, &MainWindow::load);
-  connect(interpreter, &BasicInterpreter::needPrintExpTree, this,
-          &MainWindow::printExpTree);
-  connect(interpreter, &BasicInterpreter::needClearScreen, this,
-          &MainWindow::clearScreen);
-  connect(interpreter, &BasicInterpreter::needPopUp, this,
-          &MainWindow::notifyError);
-  connect(interpreter, &BasicInterpreter::needHighlight, this,
-          &MainWindow::HightLines);
+  interpreter->setEngine(engine());
+  interpreter->setOptimizedTree(ui->optimizedTreeBox->isChecked());
+  interpreter->moveToThread(worker);
+  channel->attach(interpreter);
+  // queued, debug runs on the interpreter thread
   connect(ui->debugButton, &QPushButton::clicked, interpreter,
           &BasicInterpreter::debug);
-  connect(interpreter, &BasicInterpreter::needPrintEnv, this,
-          &MainWindow::printEnv);
-  connect(interpreter, &BasicInterpreter::modeChanged, this,
-          &MainWindow::detectMode);
-  connect(interpreter, &BasicInterpreter::sourceChanged, this,
-          &MainWindow::updateSource);
 }
 
-void MainWindow::HightLines(QList<QPair<int, QColor>> lines) {
-  // generate index for each line
-  int j = 0;
-  QString src = ui->source->toPlainText();
-  QVector<int> index;
-  index.push_back(0);
-  while ((j = src.indexOf('\n', j)) != -1) index.push_back(++j);
+void MainWindow::send(const QString &cmd) {
+  QMetaObject::invokeMethod(interpreter,
+                            [i = interpreter, cmd]() { i->parseCmd(cmd); });
+}
 
+void MainWindow::HightLines(QList<QPair<int, QColor>> lines) {
   // hightlight
   QList<QTextEdit::ExtraSelection> extras;
   QTextCursor cursor(ui->source->document());
@@ -81,7 +118,7 @@ void MainWindow::HightLines(QList<QPair<int, QColor>> lines) {
   for (auto &line : lines) {
     QTextEdit::ExtraSelection h;
     h.cursor = cursor;
-    h.cursor.setPosition(index[line.first]);
+    h.cursor.setPosition(lineStarts[line.first]);
     h.cursor.movePosition(QTextCursor::StartOfLine);
     h.cursor.movePosition(QTextCursor::EndOfLine);
     h.format.setProperty(QTextFormat::FullWidthSelection, true);
@@ -94,32 +131,49 @@ void MainWindow::HightLines(QList<QPair<int, QColor>> lines) {
 
 void MainWindow::load() {
   QString fileName = QFileDialog::getOpenFileName(this, "Open the file");
-  QFile file(fileName);
-  if (!file.open(QIODevice::ReadOnly | QFile::Text)) {
+  auto *file = new QFile(fileName);
+  if (!file->open(QIODevice::ReadOnly | QFile::Text)) {
     QMessageBox::warning(this, "Warning",
-                         "Cannot open file: " + file.errorString());
+                         "Cannot open file: " + file->errorString());
+    delete file;
     return;
   }
   setWindowTitle(fileName);
-  QTextStream in(&file);
 
-  if (interpreter) delete interpreter;
+  if (interpreter) {
+    interpreter->requestStop();
+    interpreter->deleteLater();
+  }
   newInterpreter();
-  clearScreen();
+  clearScreen(QString());
+
+  // the file is read and closed on the interpreter thread
+  file->moveToThread(worker);
+  QMetaObject::invokeMethod(interpreter, [i = interpreter, file]() {
+    i->load(file);
+    delete file;
+  });
+}
 
-  while (!in.atEnd()) interpreter->parseCmd(in.readLine());
+void MainWindow::loadProgress(qint64 done, qint64 total) {
+  statusBar()->showMessage(
+      QString("Loading... %1%").arg(total ? done * 100 / total : 100));
+}
 
-  file.close();
+void MainWindow::loadFinished(int lines, qint64 elapsed) {
+  statusBar()->showMessage(QString("Loaded %1 lines in %2 ms")
+                               .arg(lines)
+                               .arg(elapsed));
 }
 
-void MainWindow::clear() { interpreter->parseCmd("CLEAR"); }
+void MainWindow::clear() { send("CLEAR"); }
 
-void MainWindow::clearScreen() {
+void MainWindow::clearScreen(QString source) {
   ui->cmd->clear();
   ui->output->clear();
   ui->expressionTree->clear();
-  ui->environment->clear();
-  ui->source->setText(interpreter->getSource());
+  envModel->clear();
+  setSource(source);
 
   QList<QTextEdit::ExtraSelection> extras;
   ui->source->setExtraSelections(extras);
@@ -133,41 +187,77 @@ void MainWindow::detectMode(BasicInterpreter::Mode mode) {
   switch (mode) {
     case BasicInterpreter::Debug:
       ui->cmd->setDisabled(true);
+      ui->stopButton->setDisabled(false);
       ui->clearButton->setDisabled(true);
       ui->loadButton->setDisabled(true);
       break;
     case BasicInterpreter::Immediate:
       ui->cmd->setDisabled(true);
+      ui->stopButton->setDisabled(true);
       ui->debugButton->setDisabled(true);
       ui->excuteButton->setDisabled(true);
+      ui->engineBox->setDisabled(true);
       ui->clearButton->setDisabled(true);
       ui->loadButton->setDisabled(true);
       break;
     case BasicInterpreter::Normal:
+      // a stopped program no longer waits for its input
+      ui->output->setReadOnly(true);
       ui->cmd->setDisabled(false);
+      ui->stopButton->setDisabled(true);
       ui->debugButton->setDisabled(false);
       ui->excuteButton->setDisabled(false);
+      ui->engineBox->setDisabled(false);
       ui->clearButton->setDisabled(false);
       ui->loadButton->setDisabled(false);
       break;
     case BasicInterpreter::Run:
       ui->cmd->setDisabled(true);
+      ui->stopButton->setDisabled(false);
       ui->debugButton->setDisabled(true);
       ui->excuteButton->setDisabled(true);
+      ui->engineBox->setDisabled(true);
       ui->clearButton->setDisabled(true);
       ui->loadButton->setDisabled(true);
       break;
   }
 }
 
-void MainWindow::updateSource() {
-  ui->source->setText(interpreter->getSource());
+void MainWindow::updateSource(QString source) { setSource(source); }
+
+void MainWindow::setSource(const QString &source) {
+  ui->source->setText(source);
+  lineStarts.clear();
+  lineStarts.push_back(0);
+  int j = 0;
+  while ((j = source.indexOf('\n', j)) != -1) lineStarts.push_back(++j);
+}
+
+void MainWindow::execute() { send("RUN"); }
+
+void MainWindow::stop() {
+  // the flag reaches a running program at once, stop is queued behind it
+  interpreter->requestStop();
+  QMetaObject::invokeMethod(interpreter, [i = interpreter]() { i->stop(); });
+}
+
+void MainWindow::selectEngine() {
+  QMetaObject::invokeMethod(
+      interpreter, [i = interpreter, e = engine()]() { i->setEngine(e); });
 }
 
-void MainWindow::execute() { interpreter->parseCmd("RUN"); }
+void MainWindow::selectOptimizedTree(bool optimized) {
+  QMetaObject::invokeMethod(interpreter, [i = interpreter, optimized]() {
+    i->setOptimizedTree(optimized);
+  });
+}
+
+BasicInterpreter::Engine MainWindow::engine() const {
+  return BasicInterpreter::Engine(ui->engineBox->currentData().toInt());
+}
 
 void MainWindow::getCMD() {
-  interpreter->parseCmd(ui->cmd->text().simplified());
+  send(ui->cmd->text().simplified());
   ui->cmd->clear();
 }
 
@@ -183,4 +273,3 @@ void MainWindow::printExpTree(QString output) {
   ui->expressionTree->setText(output);
 }
 
-void MainWindow::printEnv(QString output) { ui->environment->setText(output); }
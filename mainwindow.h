@@ -4,13 +4,17 @@
 #include <QColor>
 #include <QDebug>
 #include <QFileDialog>
+#include <QHeaderView>
 #include <QKeyEvent>
 #include <QMainWindow>
 #include <QMessageBox>
+#include <QThread>
 
 #include "basicinterpreter.h"
 #include "environment.h"
+#include "environmentmodel.h"
 #include "expression.h"
+#include "guichannel.h"
 #include "statement.h"
 
 QT_BEGIN_NAMESPACE
@@ -30,7 +34,7 @@ class MainWindow : public QMainWindow {
 
  public:
   MainWindow(QWidget *parent = nullptr);
-  // process enter key in output
+  // process enter key in output, track the visibility of environment
   bool eventFilter(QObject *watched, QEvent *event);
   ~MainWindow();
 
@@ -38,12 +42,31 @@ class MainWindow : public QMainWindow {
   Ui::MainWindow *ui;
   BasicInterpreter *interpreter;
 
+  // the interpreter runs on worker, its signals come back through channel
+  QThread *worker;
+  GuiChannel *channel;
+
+  // shown by the environment view
+  EnvironmentModel *envModel;
+
   // wrapper for create a new interpreter and connect all signals
   void newInterpreter();
 
+  // the engine chosen in the engine selector
+  BasicInterpreter::Engine engine() const;
+
+  // forward a command to the interpreter thread
+  void send(const QString &cmd);
+
   // highlight lines
   void HightLines(QList<QPair<int, QColor>> lines);
 
+  // position where each line of the source view starts
+  QVector<int> lineStarts;
+
+  // show source and rebuild lineStarts
+  void setSource(const QString &source);
+
  public slots:
   // handler for load button
   void load();
@@ -54,6 +77,15 @@ class MainWindow : public QMainWindow {
   // handler for run button
   void execute();
 
+  // handler for stop button
+  void stop();
+
+  // handler for engine selector
+  void selectEngine();
+
+  // handler for optimized tree check box
+  void selectOptimizedTree(bool optimized);
+
   // forward command to basic interpreter
   void getCMD();
 
@@ -66,11 +98,8 @@ class MainWindow : public QMainWindow {
   // print a exp tree to expression tree window
   void printExpTree(QString output);
 
-  // print environment
-  void printEnv(QString output);
-
-  // clear screen
-  void clearScreen();
+  // clear screen and show source
+  void clearScreen(QString source);
 
   // notify error
   void notifyError(QString err);
@@ -79,6 +108,12 @@ class MainWindow : public QMainWindow {
   void detectMode(BasicInterpreter::Mode mode);
 
   // update source
-  void updateSource();
+  void updateSource(QString source);
+
+  // report how much of the file is loaded
+  void loadProgress(qint64 done, qint64 total);
+
+  // report how long loading took
+  void loadFinished(int lines, qint64 elapsed);
 };
 #endif  // MAINWINDOW_H
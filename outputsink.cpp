@@ -0,0 +1,46 @@
+#include "outputsink.h"
+
+BufferedOutputSink::BufferedOutputSink(int capacity) : capacity(capacity) {
+  buffer.reserve(capacity + 16);
+}
+
+void BufferedOutputSink::print(int value) {
+  // digits are produced backwards into the end of a small array
+  QChar digits[12];
+  QChar *end = digits + 12, *p = end;
+  *--p = '\n';
+  unsigned u = value < 0 ? 0u - unsigned(value) : unsigned(value);
+  do {
+    *--p = QChar(ushort('0' + u % 10));
+    u /= 10;
+  } while (u);
+  if (value < 0) *--p = '-';
+  buffer.append(p, end - p);
+  if (buffer.size() >= capacity) flush();
+}
+
+void BufferedOutputSink::print(const QString &line) {
+  buffer.append(line);
+  buffer.append('\n');
+  if (buffer.size() >= capacity) flush();
+}
+
+void BufferedOutputSink::flush() {
+  if (buffer.isEmpty()) return;
+  write(buffer);
+  // keeps the allocation unless write kept a copy of the buffer
+  buffer.resize(0);
+}
+
+SignalOutputSink::SignalOutputSink(QObject *parent) : QObject(parent) {}
+
+void SignalOutputSink::write(const QString &chunk) {
+  emit needOutput(chunk.chopped(1));
+}
+
+StreamOutputSink::StreamOutputSink(QTextStream &stream) : stream(stream) {}
+
+void StreamOutputSink::write(const QString &chunk) {
+  stream << chunk;
+  stream.flush();
+}
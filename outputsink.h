@@ -0,0 +1,82 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <QObject>
+#include <QString>
+#include <QTextStream>
+
+/*
+ * Class: OutputSink
+ * -----------------
+ * This class receives the lines printed by PRINT and PRINTF.
+ */
+class OutputSink {
+ public:
+  // print one line
+  virtual void print(int value) = 0;
+  virtual void print(const QString &line) = 0;
+
+  // deliver everything printed so far
+  virtual void flush() = 0;
+
+  virtual ~OutputSink() = default;
+};
+
+/*
+ * Class: BufferedOutputSink
+ * -------------------------
+ * This class collects lines in a reusable buffer and writes them in
+ * chunks of about capacity characters, or when flushed.
+ * Integers are formatted straight into the buffer.
+ */
+class BufferedOutputSink : public OutputSink {
+ public:
+  explicit BufferedOutputSink(int capacity = 1 << 16);
+  void print(int value) override;
+  void print(const QString &line) override;
+  void flush() override;
+
+ protected:
+  // write a chunk of lines, each one ends with '\n'
+  virtual void write(const QString &chunk) = 0;
+
+ private:
+  QString buffer;
+  int capacity;
+};
+
+/*
+ * Class: SignalOutputSink
+ * -----------------------
+ * A buffered sink which hands every chunk to a signal(used by the GUI).
+ */
+class SignalOutputSink : public QObject, public BufferedOutputSink {
+  Q_OBJECT
+ public:
+  explicit SignalOutputSink(QObject *parent = nullptr);
+
+ signals:
+  // require printing, lines are separated by '\n'
+  void needOutput(QString output);
+
+ protected:
+  void write(const QString &chunk) override;
+};
+
+/*
+ * Class: StreamOutputSink
+ * -----------------------
+ * A buffered sink which writes to a stream, e.g. stdout or a file.
+ */
+class StreamOutputSink : public BufferedOutputSink {
+ public:
+  explicit StreamOutputSink(QTextStream &stream);
+
+ protected:
+  void write(const QString &chunk) override;
+
+ private:
+  QTextStream &stream;
+};
+
+#endif  // OUTPUTSINK_H
@@ -0,0 +1,100 @@
+#include "program.h"
+
+#include <algorithm>
+
+#include "expression.h"
+#include "statement.h"
+
+Program::Program() : pool(new ExpressionPool) {}
+
+Program::~Program() {
+  statements.clear();
+  delete pool;
+}
+
+Program::const_iterator Program::constFind(int line) const {
+  int i = lowerBound(line);
+  if (i == entries.size() || entries[i].line != line) return constEnd();
+  return const_iterator(this, i);
+}
+
+int Program::rank(int line) const { return lowerBound(line); }
+
+void Program::insert(int line, QStringView code) {
+  int offset = text.size();
+  text.append(code);
+  int length = code.size();
+
+  Statement *statement = nullptr;
+  // the line is simplified, its first word is the statement type
+  int space = code.indexOf(u' ');
+  QStringView type = code.left(space == -1 ? code.size() : space);
+  if (type == u"REM")
+    statement = statements.make<RemStatement>(text, offset, length);
+  else if (type == u"LET")
+    statement = statements.make<LetStatement>(text, offset, length);
+  else if (type == u"PRINT")
+    statement = statements.make<PrintStatement>(text, offset, length);
+  else if (type == u"INPUT")
+    statement = statements.make<InputStatement>(text, offset, length);
+  else if (type == u"INPUTS")
+    statement = statements.make<InputsStatement>(text, offset, length);
+  else if (type == u"GOTO")
+    statement = statements.make<GotoStatement>(text, offset, length);
+  else if (type == u"IF")
+    statement = statements.make<IfStatement>(text, offset, length);
+  else if (type == u"END")
+    statement = statements.make<EndStatement>(text, offset, length);
+  else if (type == u"PRINTF")
+    statement = statements.make<PrintfStatement>(text, offset, length);
+  else
+    statement = statements.make<InvalidStatement>(text, offset, length);
+
+  int i = lowerBound(line);
+  if (i < entries.size() && entries[i].line == line) {
+    garbage += entries[i].statement->length;
+    statements.destroy(entries[i].statement);
+    entries[i].statement = statement;
+  } else
+    entries.insert(i, Entry{line, statement});
+  compact();
+}
+
+bool Program::remove(int line) {
+  int i = lowerBound(line);
+  if (i == entries.size() || entries[i].line != line) return false;
+  garbage += entries[i].statement->length;
+  statements.destroy(entries[i].statement);
+  entries.removeAt(i);
+  compact();
+  return true;
+}
+
+void Program::clear() {
+  entries.clear();
+  text.clear();
+  garbage = 0;
+  statements.clear();
+}
+
+int Program::lowerBound(int line) const {
+  auto i = std::lower_bound(
+      entries.constBegin(), entries.constEnd(), line,
+      [](const Entry &entry, int line) { return entry.line < line; });
+  return int(i - entries.constBegin());
+}
+
+void Program::compact() {
+  if (garbage <= text.size() / 2) return;
+  QString packed;
+  packed.reserve(text.size() - garbage);
+  for (Entry &entry : entries) {
+    Statement *statement = entry.statement;
+    int offset = packed.size();
+    packed.append(QStringView(text).mid(statement->offset, statement->length));
+    statement->offset = offset;
+  }
+  // statements point to text itself, so only its contents are replaced
+  text = packed;
+  garbage = 0;
+}
@@ -0,0 +1,121 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+#include "arena.h"
+#include "declarations.h"
+
+/*
+ * Class: Program
+ * --------------
+ * This class stores the numbered lines of a program compactly.
+ * The text of every line lives in one buffer that statements refer to by
+ * offset, the statements live in an arena, and (line, statement) pairs
+ * are kept in a vector sorted by line number, so the offset of a line is
+ * its index. Expressions of every line share their nodes through one
+ * ExpressionPool. The interface follows the part of QMap<int, Statement *>
+ * the interpreter needs.
+ */
+class Program {
+ private:
+  struct Entry {
+    int line;
+    Statement *statement;
+  };
+
+ public:
+  /*
+   * Class: const_iterator
+   * ---------------------
+   * A position in the program, it stays usable while lines are added
+   * or removed, but may then point to another line.
+   */
+  class const_iterator {
+   public:
+    const_iterator() = default;
+    int key() const { return program->entries[index].line; }
+    Statement *value() const { return program->entries[index].statement; }
+    // how many lines are before this one
+    int position() const { return index; }
+    const_iterator &operator++() {
+      index++;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      index++;
+      return old;
+    }
+    bool operator==(const const_iterator &other) const {
+      return program == other.program && index == other.index;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class Program;
+    const_iterator(const Program *program, int index)
+        : program(program), index(index) {}
+    const Program *program = nullptr;
+    int index = 0;
+  };
+
+  Program();
+  Program(const Program &) = delete;
+  Program &operator=(const Program &) = delete;
+  ~Program();
+
+  const_iterator constBegin() const { return const_iterator(this, 0); }
+  const_iterator constEnd() const {
+    return const_iterator(this, entries.size());
+  }
+
+  // return the position of line, constEnd if it does not exist
+  const_iterator constFind(int line) const;
+
+  bool empty() const { return entries.isEmpty(); }
+  int size() const { return entries.size(); }
+
+  // return how many lines are before line
+  int rank(int line) const;
+
+  // insert code as line, or replace it, the type of the statement is
+  // chosen by the first word of code
+  void insert(int line, QStringView code);
+
+  // remove line, return false if it does not exist
+  bool remove(int line);
+
+  // remove every line and free all the memory at once
+  void clear();
+
+  // where statements of the program intern their expressions
+  ExpressionPool &expressions() { return *pool; }
+
+ private:
+  QVector<Entry> entries;
+
+  // text of the lines, statements keep offsets into it
+  QString text;
+
+  // characters of text no longer used by any line
+  int garbage = 0;
+
+  // owns every statement
+  Arena statements{1 << 16};
+
+  // outlives the statements, whose expressions hold nodes of it
+  ExpressionPool *pool;
+
+  // position of the first line not before line
+  int lowerBound(int line) const;
+
+  // drop the garbage of text once it makes up most of it
+  void compact();
+};
+
+#endif  // PROGRAM_H
@@ -0,0 +1,46 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QAtomicInteger>
+#include <utility>
+
+/*
+ * Class: RingBuffer
+ * -----------------
+ * A bounded lock-free queue for exactly one producer thread and one
+ * consumer thread. Capacity must be a power of two.
+ */
+template <typename T, unsigned Capacity>
+class RingBuffer {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  // producer only, return false if the buffer is full
+  bool push(const T &item) {
+    unsigned t = tail.loadRelaxed();
+    if (t - head.loadAcquire() == Capacity) return false;
+    items[t & (Capacity - 1)] = item;
+    tail.storeRelease(t + 1);
+    return true;
+  }
+
+  // consumer only, return false if the buffer is empty
+  bool pop(T &item) {
+    unsigned h = head.loadRelaxed();
+    if (h == tail.loadAcquire()) return false;
+    // leave an empty item behind so shared data is released now
+    item = std::exchange(items[h & (Capacity - 1)], T());
+    head.storeRelease(h + 1);
+    return true;
+  }
+
+ private:
+  T items[Capacity];
+
+  // head is the next item to pop, tail the next one to push,
+  // both only grow and wrap around together
+  QAtomicInteger<unsigned> head = 0, tail = 0;
+};
+
+#endif  // RINGBUFFER_H
@@ -1,83 +1,128 @@
 #include "statement.h"
-RemStatement::RemStatement(const QString &l) {
-  statementType = REM;
-  line = l;
+
+Statement::Statement(StatementType type, const QString &text, int offset,
+                     int length)
+    : statementType(type),
+      text(&text),
+      offset(offset),
+      length(length == -1 ? text.size() - offset : length) {}
+
+Statement::Span Statement::spanOf(QStringView part) const {
+  return Span{int(part.data() - line().data()), int(part.size())};
 }
 
-LetStatement::LetStatement(QString l) {
-  line = l;
-  statementType = LET;
+QStringView Statement::view(Span span) const {
+  return line().mid(span.offset, span.length);
 }
 
-QString LetStatement::getVariable() { return variable; }
+RemStatement::RemStatement(const QString &text, int offset, int length)
+    : Statement(REM, text, offset, length) {}
+
+LetStatement::LetStatement(const QString &text, int offset, int length)
+    : Statement(LET, text, offset, length) {}
+
+QString LetStatement::getVariable() { return view(variable).toString(); }
+
+int LetStatement::getSlot() { return slot; }
 
 Expression *LetStatement::getFirstExp() { return exp; }
 
-PrintStatement::PrintStatement(QString l) {
-  line = l;
-  statementType = PRINT;
-}
+PrintStatement::PrintStatement(const QString &text, int offset, int length)
+    : Statement(PRINT, text, offset, length) {}
 
 Expression *PrintStatement::getFirstExp() { return exp; }
 
-InputStatement::InputStatement(QString l) {
-  line = l;
-  statementType = INPUT;
-}
+InputStatement::InputStatement(const QString &text, int offset, int length)
+    : Statement(INPUT, text, offset, length) {}
 
-QString InputStatement::getVariable() { return variable; }
+QString InputStatement::getVariable() { return view(variable).toString(); }
 
-GotoStatement::GotoStatement(QString l) {
-  line = l;
-  statementType = GOTO;
-}
+int InputStatement::getSlot() { return slot; }
+
+GotoStatement::GotoStatement(const QString &text, int offset, int length)
+    : Statement(GOTO, text, offset, length) {}
 
 int GotoStatement::getLineNumber() { return lineNumber; }
 
-IfStatement::IfStatement(QString l) {
-  line = l;
-  statementType = IF;
+bool GotoStatement::link(const Program &src) {
+  target = src.constFind(lineNumber);
+  return target != src.constEnd();
 }
 
+Program::const_iterator GotoStatement::getTarget() { return target; }
+
+IfStatement::IfStatement(const QString &text, int offset, int length)
+    : Statement(IF, text, offset, length) {}
+
 Expression *IfStatement::getFirstExp() { return exp1; }
 
 Expression *IfStatement::getSecondExp() { return exp2; }
 
-QString IfStatement::getOperator() { return op; }
+QString IfStatement::getOperator() {
+  static const char *operators[] = {">", "=", "<"};
+  return operators[comparison];
+}
+
+Comparison IfStatement::getComparison() { return comparison; }
 
 int IfStatement::getLineNumber() { return lineNumber; }
 
-void IfStatement::parse() {
-  QString l = line;
-  l = l.remove("IF").simplified();
-  if (l.contains('='))
-    op = '=';
-  else if (l.contains('<'))
-    op = '<';
-  else if (l.contains('>'))
-    op = '>';
+bool IfStatement::link(const Program &src) {
+  target = src.constFind(lineNumber);
+  return target != src.constEnd();
+}
+
+Program::const_iterator IfStatement::getTarget() { return target; }
+
+void IfStatement::parse(ExpressionPool &pool) {
+  // IF expression op expression THEN line
+  Lexer lexer(line());
+  int i = 1;
+  while (i < lexer.size() && !lexer[i].is(u"=") && !lexer[i].is(u"<") &&
+         !lexer[i].is(u">"))
+    i++;
+  if (i == lexer.size()) throw QStringException("Invalid Statement");
+  if (lexer[i].is(u"="))
+    comparison = EQUAL;
+  else if (lexer[i].is(u"<"))
+    comparison = LESS;
   else
-    throw QStringException("Invalid Statement");
-  auto split_op = l.split(op);
-  exp1 = new Expression(split_op[0].simplified());
-  auto split_then = split_op[1].split("THEN");
-  exp2 = new Expression(split_then[0].simplified());
-  bool ok = false;
-  lineNumber = split_then[1].toInt(&ok);
-  if (!ok) throw QStringException("Invalid Statement");
+    comparison = GREATER;
+  int then = lexer.indexOf(u"THEN", i + 1);
+  if (then == -1) throw QStringException("Invalid Statement");
+  // a failed parse must not leave a deleted expression behind
+  delete exp1;
+  delete exp2;
+  exp1 = exp2 = nullptr;
+  exp1 = new Expression(pool, lexer.begin() + 1, lexer.begin() + i);
+  exp2 = new Expression(pool, lexer.begin() + i + 1, lexer.begin() + then);
+  lineNumber = parseLineNumber(lexer, then + 1);
 }
 
-EndStatement::EndStatement(const QString &l) {
-  line = l;
-  statementType = END;
-}
+EndStatement::EndStatement(const QString &text, int offset, int length)
+    : Statement(END, text, offset, length) {}
 
-QString Statement::toString() const { return line; }
+QString Statement::toString() const { return line().toString(); }
 
 QString Statement::getVariable() {
   throw QStringException("unimplemented function");
 }
 
+int Statement::getSlot() { throw QStringException("unimplemented function"); }
+
+void Statement::optimize() {}
+
+void Statement::resolve(Environment & /* unused */) {}
+
+void Statement::hoistInvariants(const QSet<int> * /* unused */,
+                                Environment & /* unused */) {}
+
+bool Statement::link(const Program & /* unused */) { return true; }
+
+Program::const_iterator Statement::getTarget() {
+  throw QStringException("unimplemented function");
+}
+
 int Statement::getConstant() {
   throw QStringException("unimplemented function");
 }
@@ -90,6 +135,10 @@ QString Statement::getOperator() {
   throw QStringException("unimplemented function");
 }
 
+Comparison Statement::getComparison() {
+  throw QStringException("unimplemented function");
+}
+
 Expression *Statement::getFirstExp() {
   throw QStringException("unimplemented function");
 }
@@ -98,234 +147,262 @@ Expression *Statement::getSecondExp() {
   throw QStringException("unimplemented function");
 }
 
-bool Statement::validifyVar(QString var) {
-  if (!var[0].isLetter()) return false;
-  for (auto c : var)
-    if (!c.isLetterOrNumber()) return false;
-  return true;
+int Statement::parseLineNumber(const Lexer &lexer, int from) {
+  // an optional sign and an integer that end the line
+  bool negative = false;
+  if (from < lexer.size() && (lexer[from].is(u"-") || lexer[from].is(u"+")))
+    negative = lexer[from++].is(u"-");
+  bool ok = false;
+  int number = 0;
+  if (from + 1 == lexer.size() && lexer[from].type == Lexer::INTEGER)
+    number = Lexer::toInt(lexer[from].text, &ok);
+  if (!ok) throw QStringException("Invalid Statement");
+  return negative ? -number : number;
 }
 
-QString RemStatement::toTree() {
+QString RemStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   QString tree("REM\n");
-  tree.append("    " + line.mid(line.indexOf(" ") + 1) + "\n");
+  QStringView text = line();
+  tree.append("    " + text.mid(text.indexOf(u' ') + 1).toString() + "\n");
   return tree;
 }
 
-void RemStatement::parse() {}
+void RemStatement::parse(ExpressionPool & /* unused */) {}
 
-QString LetStatement::toTree() {
+QString LetStatement::toTree(bool optimized) {
   if (statementType == ERR) return "ERR\n";
-  if (variableType == STR) return "LET = \"" + val + "\"\n";
+  if (variableType == STR) return "LET = \"" + getVal() + "\"\n";
   QString tree("LET =\n");
-  tree.append("    " + variable + '\n');
-  tree.append(exp->toTree() + '\n');
+  tree.append("    " + getVariable() + '\n');
+  tree.append(exp->toTree(optimized) + '\n');
   return tree;
 }
 
 VariableType LetStatement::getType() const { return variableType; }
 
-QString LetStatement::getVal() const { return val; }
-
-void LetStatement::parse() {
-  auto extractStr = [](QString s) {
-    if (!((s.front() == '"' && s.back() == '"') ||
-          (s.front() == '\'' && s.back() == '\'')))
-      throw QStringException("Invalid Statement");
-    s = s.mid(1, s.length() - 2);
-    if (s.indexOf('"') != -1 || s.indexOf('\'') != -1)
-      throw QStringException("Invalid Statement");
-    return s;
-  };
-
-  QString l = line;
-  l = l.remove("LET").simplified();
-
-  if (l.indexOf("=") == -1) throw QStringException("Invalid Statement");
-  auto part = l.split("=");
-  if (part.size() != 2) throw QStringException("Invalid Statement");
-  variable = part[0].simplified();
+QString LetStatement::getVal() const { return view(val).toString(); }
 
-  if (!validifyVar(variable)) throw QStringException("Invalid Variable name");
+void LetStatement::parse(ExpressionPool &pool) {
+  // LET variable = expression or LET variable = "string"
+  Lexer lexer(line());
+  int equal = lexer.indexOf(u"=");
+  if (equal == -1) throw QStringException("Invalid Statement");
+  if (equal != 2 || lexer[1].type != Lexer::IDENTIFIER)
+    throw QStringException("Invalid Variable name");
+  variable = spanOf(lexer[1].text);
 
   // string
-  if (l.indexOf("\"") != -1 || l.indexOf("'") != -1) {
-    variableType = STR;
-    val = extractStr(part[1].simplified());
-  } else if (l.indexOf("'") != -1) {
-    int i = l.indexOf("'");
-    if (l.back() != '\'') throw QStringException("Invalid Statement");
+  if (equal + 2 == lexer.size() && lexer[equal + 1].type == Lexer::STRING) {
     variableType = STR;
-    val = l.mid(i + 1, l.length() - i - 2);
-    if (val.indexOf("\"") != -1 || val.indexOf("'") != -1)
-      throw QStringException("Invalid Statement");
+    val = spanOf(Lexer::unquote(lexer[equal + 1].text));
   }
   // int
   else {
     variableType = INT;
-    exp = new Expression(part[1].simplified());
+    delete exp;
+    exp = nullptr;
+    exp = new Expression(pool, lexer.begin() + equal + 1, lexer.end());
   }
 }
 
-LetStatement::~LetStatement() {
-  if (variableType == INT) delete exp;
+void LetStatement::optimize() {
+  if (variableType != INT) return;
+  exp->optimize();
+  Expression::eliminateCommon({exp});
+}
+
+void LetStatement::resolve(Environment &env) {
+  slot = env.getSlot(getVariable());
+  if (variableType == INT) exp->resolve(env);
+}
+
+void LetStatement::hoistInvariants(const QSet<int> *assigned,
+                                   Environment &env) {
+  if (variableType == INT) Expression::hoistInvariants({exp}, assigned, env);
 }
 
-QString InputStatement::toTree() {
+LetStatement::~LetStatement() { delete exp; }
+
+QString InputStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   QString tree("INPUT =\n");
-  tree.append("    " + variable + '\n');
+  tree.append("    " + getVariable() + '\n');
   return tree;
 }
 
-void InputStatement::parse() {
-  QString l = line;
-  l = l.remove("INPUT").simplified();
-  variable = l;
+void InputStatement::parse(ExpressionPool & /* unused */) {
+  Lexer lexer(line());
+  if (lexer.size() != 2 || lexer[1].type != Lexer::IDENTIFIER)
+    throw QStringException("Invalid Variable name");
+  variable = spanOf(lexer[1].text);
+}
 
-  if (!validifyVar(variable)) throw QStringException("Invalid Variable name");
+void InputStatement::resolve(Environment &env) {
+  slot = env.getSlot(getVariable());
 }
 
-QString GotoStatement::toTree() {
+QString GotoStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   QString tree("GOTO\n");
   tree.append("    " + QString::number(lineNumber) + '\n');
   return tree;
 }
 
-void GotoStatement::parse() {
-  QString l = line;
-  l = l.remove("GOTO").simplified();
-  bool ok = false;
-  lineNumber = l.toInt(&ok);
-  if (!ok) throw QStringException("Invalid Statement");
+void GotoStatement::parse(ExpressionPool & /* unused */) {
+  Lexer lexer(line());
+  lineNumber = parseLineNumber(lexer, 1);
 }
 
-QString IfStatement::toTree() {
+QString IfStatement::toTree(bool optimized) {
   if (statementType == ERR) return "ERR\n";
   QString tree("IF THEN\n");
-  tree.append(exp1->toTree() + '\n');
-  tree.append("    " + op + '\n');
-  tree.append(exp2->toTree() + '\n');
+  tree.append(exp1->toTree(optimized) + '\n');
+  tree.append("    " + getOperator() + '\n');
+  tree.append(exp2->toTree(optimized) + '\n');
   tree.append("    " + QString::number(lineNumber) + '\n');
   return tree;
 }
 
+void IfStatement::optimize() {
+  exp1->optimize();
+  exp2->optimize();
+  // execute evaluates exp1 before exp2
+  Expression::eliminateCommon({exp1, exp2});
+}
+
+void IfStatement::resolve(Environment &env) {
+  exp1->resolve(env);
+  exp2->resolve(env);
+}
+
+void IfStatement::hoistInvariants(const QSet<int> *assigned,
+                                  Environment &env) {
+  Expression::hoistInvariants({exp1, exp2}, assigned, env);
+}
+
 IfStatement::~IfStatement() {
   delete exp1;
   delete exp2;
 }
 
-QString EndStatement::toTree() {
+QString EndStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   return "END";
 }
 
-void EndStatement::parse() {}
+void EndStatement::parse(ExpressionPool & /* unused */) {}
 
-QString PrintStatement::toTree() {
+QString PrintStatement::toTree(bool optimized) {
   if (statementType == ERR) return "ERR\n";
   QString tree("PRINT\n");
-  tree.append(exp->toTree() + '\n');
+  tree.append(exp->toTree(optimized) + '\n');
   return tree;
 }
 
-void PrintStatement::parse() {
-  QString l = line;
-  l = l.remove("PRINT").simplified();
-  exp = new Expression(l);
+void PrintStatement::parse(ExpressionPool &pool) {
+  Lexer lexer(line());
+  delete exp;
+  exp = nullptr;
+  exp = new Expression(pool, lexer.begin() + 1, lexer.end());
 }
 
-PrintStatement::~PrintStatement() { delete exp; }
+void PrintStatement::optimize() {
+  exp->optimize();
+  Expression::eliminateCommon({exp});
+}
 
-InvalidStatement::InvalidStatement(const QString &l) {
-  line = l;
-  statementType = ERR;
+void PrintStatement::resolve(Environment &env) { exp->resolve(env); }
+
+void PrintStatement::hoistInvariants(const QSet<int> *assigned,
+                                     Environment &env) {
+  Expression::hoistInvariants({exp}, assigned, env);
 }
 
-QString InvalidStatement::toTree() {
+PrintStatement::~PrintStatement() { delete exp; }
+
+InvalidStatement::InvalidStatement(const QString &text, int offset, int length)
+    : Statement(ERR, text, offset, length) {}
+
+QString InvalidStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   throw QStringException("Can't call toTree of an invalid statement");
 }
 
-void InvalidStatement::parse() { throw QStringException("Invalid Statement"); }
-
-PrintfStatement::PrintfStatement(const QString &l) {
-  line = l;
-  statementType = PRINTF;
+void InvalidStatement::parse(ExpressionPool & /* unused */) {
+  throw QStringException("Invalid Statement");
 }
 
-QString PrintfStatement::toTree() {
+PrintfStatement::PrintfStatement(const QString &text, int offset, int length)
+    : Statement(PRINTF, text, offset, length) {}
+
+QString PrintfStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   QString tree("PRINTF\n");
-  tree.append("    " + line.mid(line.indexOf(" ") + 1) + "\n");
+  QStringView text = line();
+  tree.append("    " + text.mid(text.indexOf(u' ') + 1).toString() + "\n");
   return tree;
 }
 
-void PrintfStatement::parse() {
-  auto l = line;
+void PrintfStatement::parse(ExpressionPool & /* unused */) {
+  // PRINTF "format", argument, ...
+  Lexer lexer(line());
   args.clear();
-  l.remove("PRINTF ");
-  QList<QString> part;
-  // split
-  int i = 0, j = 0;
-  bool inQuote = false;
-  l.append(',');
-  for (int j = 0; j < l.length(); j++) {
-    if (l[j] == '"' || l[j] == '\'') inQuote = !inQuote;
-    if (l[j] == ',' && !inQuote) {
-      part.append(l.mid(i, j - i));
-      i = j + 1;
-    }
-  }
-
-  format = part[0].simplified();
-  if (!((format.front() == '"' && format.back() == '"') ||
-        (format.front() == '\'' && format.back() == '\'')))
-    throw QStringException("Invalid Statement");
-  format = format.mid(1, format.length() - 2);
-  if (format.indexOf('"') != -1 || format.indexOf('\'') != -1)
+  if (lexer.size() < 2 || lexer[1].type != Lexer::STRING)
     throw QStringException("Invalid Statement");
+  format = spanOf(Lexer::unquote(lexer[1].text));
 
-  int count = 0;
-  j = 0;
-  while ((j = format.indexOf("{}", j)) != -1) {
+  for (int i = 2; i < lexer.size(); i += 2) {
+    if (!lexer[i].is(u",") || i + 1 == lexer.size())
+      throw QStringException("Invalid Statement");
+    const Lexer::Token &arg = lexer[i + 1];
+    if (arg.type != Lexer::STRING && arg.type != Lexer::INTEGER &&
+        arg.type != Lexer::IDENTIFIER)
+      throw QStringException("Invalid Statement");
+    args.push_back(spanOf(arg.text));
+  }
+
+  QStringView formatText = view(format);
+  int count = 0, j = 0;
+  while ((j = formatText.indexOf(u"{}", j)) != -1) {
     count++;
     j++;
   }
-  if (part.size() - 1 != count) throw QStringException("Invalid Statement");
-  for (int i = 1; i < part.size(); i++) args.push_back(part[i].simplified());
+  if (args.size() != count) throw QStringException("Invalid Statement");
 }
 
-QString PrintfStatement::compose(const Environment &env) {
-  auto extractStr = [](QString s) {
-    if (!((s.front() == '"' && s.back() == '"') ||
-          (s.front() == '\'' && s.back() == '\'')))
-      throw QStringException("Invalid Statement");
-    s = s.mid(1, s.length() - 2);
-    if (s.indexOf('"') != -1 || s.indexOf('\'') != -1)
-      throw QStringException("Invalid Statement");
-    return s;
-  };
+void PrintfStatement::resolve(Environment &env) {
+  argSlots.clear();
+  for (Span span : args) {
+    QStringView arg = view(span);
+    if (arg.front() == '\'' || arg.front() == '"' || arg.front().isDigit())
+      argSlots.push_back(-1);
+    else
+      argSlots.push_back(env.getSlot(arg.toString()));
+  }
+}
 
-  QString s = format;
+QString PrintfStatement::compose(const Environment &env) {
+  QString s = view(format).toString();
 
-  for (auto &arg : args) {
+  for (int k = 0; k < args.size(); k++) {
+    const QString arg = view(args[k]).toString();
     QString argString;
     if (arg.front() == '\'' || arg.front() == '"') {
-      argString = extractStr(arg);
+      // the lexer has matched the quotes
+      argString = Lexer::unquote(arg).toString();
     } else if (arg.front().isDigit()) {
       bool ok = true;
       arg.toInt(&ok);
       if (!ok) throw QStringException("compose error");
       argString = arg;
     } else {
-      switch (env.getType(arg)) {
+      switch (env.getType(argSlots[k])) {
         case STR:
-          argString = env.getStrValue(arg);
+          argString = env.getStrValue(argSlots[k]);
           break;
         case INT:
-          argString = QString::number(env.getIntValue(arg));
+          argString = QString::number(env.getIntValue(argSlots[k]));
           break;
       }
     }
@@ -337,24 +414,37 @@ QString PrintfStatement::compose(const Environment &env) {
   return s;
 }
 
-InputsStatement::InputsStatement(QString l) {
-  line = l;
-  statementType = INPUTS;
+QString PrintfStatement::getFormat() const { return view(format).toString(); }
+
+QStringList PrintfStatement::getArgs() const {
+  QStringList list;
+  for (Span span : args) list.append(view(span).toString());
+  return list;
 }
 
-QString InputsStatement::getVariable() { return variable; }
+QVector<int> PrintfStatement::getArgSlots() const { return argSlots; }
+
+InputsStatement::InputsStatement(const QString &text, int offset, int length)
+    : Statement(INPUTS, text, offset, length) {}
+
+QString InputsStatement::getVariable() { return view(variable).toString(); }
 
-QString InputsStatement::toTree() {
+int InputsStatement::getSlot() { return slot; }
+
+QString InputsStatement::toTree(bool /* unused */) {
   if (statementType == ERR) return "ERR\n";
   QString tree("INPUTS =\n");
-  tree.append("    " + variable + '\n');
+  tree.append("    " + getVariable() + '\n');
   return tree;
 }
 
-void InputsStatement::parse() {
-  QString l = line;
-  l = l.remove("INPUTS").simplified();
-  variable = l;
+void InputsStatement::parse(ExpressionPool & /* unused */) {
+  Lexer lexer(line());
+  if (lexer.size() != 2 || lexer[1].type != Lexer::IDENTIFIER)
+    throw QStringException("Invalid Variable name");
+  variable = spanOf(lexer[1].text);
+}
 
-  if (!validifyVar(variable)) throw QStringException("Invalid Variable name");
+void InputsStatement::resolve(Environment &env) {
+  slot = env.getSlot(getVariable());
 }
@@ -1,155 +1,258 @@
 #ifndef STATEMENT_H
 #define STATEMENT_H
 
+#include <QSet>
 #include <QString>
 #include <QStringList>
+#include <QVector>
 
 #include "basicinterpreter.h"
 #include "declarations.h"
 #include "environment.h"
 #include "expression.h"
+#include "lexer.h"
+#include "program.h"
 
 /*
  * Class: Statement
  * ----------------
  * This class stores a statement
+ * The text of a statement is part of a string it does not own, names
+ * and literals parsed from it are kept as spans of that text.
  */
 class Statement {
  public:
   StatementType statementType = ERR;
+
+  // whether the statement has to be parsed before it runs,
+  // a statement is parsed once and kept until its line is replaced
+  bool dirty = true;
+
+  // the statement is length characters of text from offset,
+  // -1 means up to the end, text must outlive the statement
+  Statement(StatementType type, const QString &text, int offset, int length);
+
   virtual QString toString() const;
   virtual QString getVariable();
+  virtual int getSlot();
   virtual int getConstant();
   virtual int getLineNumber();
   virtual QString getOperator();
+  virtual Comparison getComparison();
   virtual Expression *getFirstExp();
   virtual Expression *getSecondExp();
-  virtual QString toTree() = 0;
+  // return the syntax tree, with expressions as written or optimised
+  virtual QString toTree(bool optimized = false) = 0;
   virtual ~Statement() = default;
-  virtual void parse() = 0;
+  // parse the line, expressions share their nodes through pool
+  virtual void parse(ExpressionPool &pool) = 0;
+
+  // simplify the expressions and share their common subexpressions,
+  // called after a successful parse
+  virtual void optimize();
+
+  // bind variables to their slots in env, called after a successful parse
+  virtual void resolve(Environment &env);
+
+  // hoist the subexpressions that read no slot in assigned out of the loop
+  // around the statement, assigned holds the slots written by the
+  // innermost loop, nullptr outside loops, called after resolve
+  virtual void hoistInvariants(const QSet<int> *assigned, Environment &env);
+
+  // link a jump to its target in src,
+  // return false if the target line does not exist
+  virtual bool link(const Program &src);
+  virtual Program::const_iterator getTarget();
 
  protected:
-  QString line;
-  static bool validifyVar(QString var);
+  /*
+   * Struct: Span
+   * ------------
+   * Part of the line as offsets, so it survives the text moving.
+   */
+  struct Span {
+    int offset = 0, length = 0;
+  };
+
+  // the text of the statement
+  QStringView line() const {
+    return QStringView(*text).mid(offset, length);
+  }
+
+  // part must be a view into line
+  Span spanOf(QStringView part) const;
+  QStringView view(Span span) const;
+
+  // read the line number that ends a GOTO or IF from token from
+  static int parseLineNumber(const Lexer &lexer, int from);
+
+ private:
+  // Program moves the lines when it compacts its text
+  friend class Program;
+  const QString *text;
+  int offset, length;
 };
 
 class RemStatement : public Statement {
  public:
-  explicit RemStatement(const QString &l);
-  QString toTree() override;
-  void parse() override;
+  explicit RemStatement(const QString &text, int offset = 0,
+                        int length = -1);
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
   ~RemStatement() = default;
 };
 
 class LetStatement : public Statement {
  private:
-  QString variable;
-  Expression *exp;
-  QString val;
+  Span variable;
+  int slot;
+  Expression *exp = nullptr;
+  Span val;
   VariableType variableType;
 
  public:
-  explicit LetStatement(QString l);
+  explicit LetStatement(const QString &text, int offset = 0,
+                        int length = -1);
   QString getVariable() override;
+  int getSlot() override;
   Expression *getFirstExp() override;
-  QString toTree() override;
+  QString toTree(bool optimized = false) override;
   VariableType getType() const;
   QString getVal() const;
-  void parse() override;
+  void parse(ExpressionPool &pool) override;
+  void optimize() override;
+  void resolve(Environment &env) override;
+  void hoistInvariants(const QSet<int> *assigned,
+                       Environment &env) override;
   ~LetStatement();
 };
 
 class PrintStatement : public Statement {
  private:
-  Expression *exp;
+  Expression *exp = nullptr;
 
  public:
-  explicit PrintStatement(QString l);
+  explicit PrintStatement(const QString &text, int offset = 0,
+                          int length = -1);
   Expression *getFirstExp() override;
-  QString toTree() override;
-  void parse() override;
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
+  void optimize() override;
+  void resolve(Environment &env) override;
+  void hoistInvariants(const QSet<int> *assigned,
+                       Environment &env) override;
   ~PrintStatement();
 };
 
 class InputStatement : public Statement {
  private:
-  QString variable;
+  Span variable;
+  int slot;
 
  public:
-  explicit InputStatement(QString l);
+  explicit InputStatement(const QString &text, int offset = 0,
+                          int length = -1);
   QString getVariable() override;
-  QString toTree() override;
-  void parse() override;
+  int getSlot() override;
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
+  void resolve(Environment &env) override;
   ~InputStatement() = default;
 };
 
 class GotoStatement : public Statement {
  private:
   int lineNumber;
+  Program::const_iterator target;
 
  public:
-  explicit GotoStatement(QString l);
+  explicit GotoStatement(const QString &text, int offset = 0,
+                         int length = -1);
   int getLineNumber() override;
-  QString toTree() override;
-  void parse() override;
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
+  bool link(const Program &src) override;
+  Program::const_iterator getTarget() override;
   ~GotoStatement() = default;
 };
 
 class IfStatement : public Statement {
  private:
-  QString op;
-  Expression *exp1, *exp2;
+  Comparison comparison;
+  Expression *exp1 = nullptr, *exp2 = nullptr;
   int lineNumber;
+  Program::const_iterator target;
 
  public:
-  explicit IfStatement(QString l);
+  explicit IfStatement(const QString &text, int offset = 0,
+                       int length = -1);
   Expression *getFirstExp() override;
   Expression *getSecondExp() override;
   QString getOperator() override;
+  Comparison getComparison() override;
   int getLineNumber() override;
-  void parse() override;
-  QString toTree() override;
+  void parse(ExpressionPool &pool) override;
+  void optimize() override;
+  void resolve(Environment &env) override;
+  void hoistInvariants(const QSet<int> *assigned,
+                       Environment &env) override;
+  bool link(const Program &src) override;
+  Program::const_iterator getTarget() override;
+  QString toTree(bool optimized = false) override;
   ~IfStatement();
 };
 
 class EndStatement : public Statement {
  public:
-  explicit EndStatement(const QString &l);
-  QString toTree() override;
-  void parse() override;
+  explicit EndStatement(const QString &text, int offset = 0,
+                        int length = -1);
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
   ~EndStatement() = default;
 };
 
 class InvalidStatement : public Statement {
  public:
-  explicit InvalidStatement(const QString &l);
-  QString toTree() override;
-  void parse() override;
+  explicit InvalidStatement(const QString &text, int offset = 0,
+                            int length = -1);
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
   ~InvalidStatement() = default;
 };
 
 class PrintfStatement : public Statement {
  private:
-  QString format;
-  QStringList args;
+  Span format;
+  QVector<Span> args;
+  // slot of each variable argument, -1 for literals
+  QVector<int> argSlots;
 
  public:
-  explicit PrintfStatement(const QString &l);
-  QString toTree() override;
-  void parse() override;
+  explicit PrintfStatement(const QString &text, int offset = 0,
+                           int length = -1);
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
+  void resolve(Environment &env) override;
   QString compose(const Environment &env);
+  QString getFormat() const;
+  QStringList getArgs() const;
+  QVector<int> getArgSlots() const;
   ~PrintfStatement() = default;
 };
 
 class InputsStatement : public Statement {
  private:
-  QString variable;
+  Span variable;
+  int slot;
 
  public:
-  explicit InputsStatement(QString l);
+  explicit InputsStatement(const QString &text, int offset = 0,
+                           int length = -1);
   QString getVariable() override;
-  QString toTree() override;
-  void parse() override;
+  int getSlot() override;
+  QString toTree(bool optimized = false) override;
+  void parse(ExpressionPool &pool) override;
+  void resolve(Environment &env) override;
   ~InputsStatement() = default;
 };
 
@@ -0,0 +1,136 @@
+#include "virtualmachine.h"
+
+VirtualMachine::VirtualMachine(const QAtomicInt &stop, QObject *parent)
+    : QObject(parent), stop(stop) {}
+
+int VirtualMachine::run(const Bytecode &program, Environment &env,
+                        OutputSink &output, int line) {
+  registers.fill(0, program.registerCount);
+  temps.fill(0, program.tempCount);
+
+  const Bytecode::Instruction *code = program.code.constData();
+  int *r = registers.data(), *t = temps.data();
+  Environment::BasicValue *v = env.values.data();
+  Environment::Temporary *h = env.temporaries.data();
+  int pc = program.entry(line);
+  ended = false;
+
+  // + - and * wrap around on overflow like Expression::calculate,
+  // every loop goes through a backward jump, which checks stop
+  while (true) {
+    const Bytecode::Instruction &i = code[pc++];
+    switch (i.op) {
+      case Bytecode::LOAD_CONST:
+        r[i.a] = i.b;
+        break;
+      case Bytecode::LOAD_VAR:
+        if (!v[i.b].defined)
+          throw QStringException(env.getName(i.b) +
+                                 " does not exist in runtime environment");
+        if (v[i.b].type == STR)
+          throw QStringException(
+              "expression contains's variable that has type STR");
+        r[i.a] = v[i.b].intVal;
+        break;
+      case Bytecode::STORE_INT:
+        v[i.a].defined = true;
+        v[i.a].type = INT;
+        v[i.a].intVal = r[i.b];
+        env.invalidate(i.a);
+        env.markDirty(i.a);
+        break;
+      case Bytecode::STORE_STR:
+        v[i.a].defined = true;
+        v[i.a].type = STR;
+        v[i.a].strVal = program.strings[i.b];
+        env.invalidate(i.a);
+        env.markDirty(i.a);
+        break;
+      case Bytecode::ADD:
+        r[i.a] = int(unsigned(r[i.b]) + unsigned(r[i.c]));
+        break;
+      case Bytecode::SUB:
+        r[i.a] = int(unsigned(r[i.b]) - unsigned(r[i.c]));
+        break;
+      case Bytecode::MUL:
+        r[i.a] = int(unsigned(r[i.b]) * unsigned(r[i.c]));
+        break;
+      case Bytecode::DIV:
+        r[i.a] = Expression::divide(r[i.b], r[i.c]);
+        break;
+      case Bytecode::POW:
+        r[i.a] = Expression::power(r[i.b], r[i.c]);
+        break;
+      case Bytecode::SAVE_TEMP:
+        t[i.a] = r[i.b];
+        break;
+      case Bytecode::LOAD_TEMP:
+        r[i.a] = t[i.b];
+        break;
+      case Bytecode::LOAD_HOISTED:
+        if (h[i.b].valid) {
+          r[i.a] = h[i.b].value;
+          pc = i.c;
+        }
+        break;
+      case Bytecode::SAVE_HOISTED:
+        h[i.a].value = r[i.b];
+        h[i.a].valid = true;
+        break;
+      case Bytecode::JUMP:
+        if (i.a < pc && stop.loadRelaxed()) return -2;
+        pc = i.a;
+        break;
+      case Bytecode::JUMP_GT:
+        if (r[i.b] <= r[i.c]) break;
+        if (i.a < pc && stop.loadRelaxed()) return -2;
+        pc = i.a;
+        break;
+      case Bytecode::JUMP_EQ:
+        if (r[i.b] != r[i.c]) break;
+        if (i.a < pc && stop.loadRelaxed()) return -2;
+        pc = i.a;
+        break;
+      case Bytecode::JUMP_LT:
+        if (r[i.b] >= r[i.c]) break;
+        if (i.a < pc && stop.loadRelaxed()) return -2;
+        pc = i.a;
+        break;
+      case Bytecode::PRINT_INT:
+        output.print(r[i.a]);
+        break;
+      case Bytecode::PRINT_FMT:
+        output.print(compose(program.formats[i.a], env));
+        break;
+      case Bytecode::WAIT_INPUT:
+        return i.a;
+      case Bytecode::HALT:
+        return -1;
+      case Bytecode::FAIL:
+        ended = i.b;
+        throw QStringException(program.strings[i.a]);
+    }
+  }
+}
+
+QString VirtualMachine::compose(const Bytecode::Format &format,
+                                const Environment &env) {
+  QString s = format.format;
+
+  for (const auto &arg : format.args) {
+    QString argString;
+    if (arg.slot == -1)
+      argString = arg.text;
+    else if (arg.slot == -2)
+      throw QStringException(arg.text);
+    else if (env.getType(arg.slot) == STR)
+      argString = env.getStrValue(arg.slot);
+    else
+      argString = QString::number(env.getIntValue(arg.slot));
+    int i = s.indexOf("{}");
+    s.remove(i, 2);
+    s.insert(i, argString);
+  }
+
+  return s;
+}
@@ -0,0 +1,51 @@
+#ifndef VIRTUALMACHINE_H
+#define VIRTUALMACHINE_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include "bytecode.h"
+#include "declarations.h"
+#include "environment.h"
+#include "outputsink.h"
+#include "qstringexception.h"
+
+/*
+ * Class: VirtualMachine
+ * ---------------------
+ * This class executes a Bytecode program on a register file.
+ * Variables are read and written in the slots of the Environment.
+ */
+class VirtualMachine : public QObject {
+  Q_OBJECT
+ public:
+  // the program is stopped at a backward jump once stop is not 0
+  explicit VirtualMachine(const QAtomicInt &stop, QObject *parent = nullptr);
+
+  // run the program from line(-1 means the end of the program)
+  // until END or INPUT, printing to output, return the line number
+  // of the INPUT statement, -1 if END is reached, -2 if it was stopped
+  int run(const Bytecode &program, Environment &env, OutputSink &output,
+          int line);
+
+  // whether the last run threw because the program ends(FAIL with b set),
+  // the caller resets the environment then
+  bool endsProgram() const { return ended; }
+
+ private:
+  const QAtomicInt &stop;
+
+  QVector<int> registers;
+
+  // set by a FAIL that ends the program
+  bool ended = false;
+
+  // common subexpressions of the current statement
+  QVector<int> temps;
+
+  QString compose(const Bytecode::Format &format, const Environment &env);
+};
+
+#endif  // VIRTUALMACHINE_H